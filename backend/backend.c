@@ -16,6 +16,7 @@
 #include "backend/backend.h"
 #include "backend/multi.h"
 #include "render/allocator/allocator.h"
+#include "types/wlr_output.h"
 #include "util/env.h"
 #include "util/time.h"
 
@@ -144,6 +145,171 @@ uint32_t backend_get_buffer_caps(struct wlr_backend *backend) {
 	return backend->impl->get_buffer_caps(backend);
 }
 
+static bool check_output_states(struct wlr_backend *backend,
+		const struct wlr_backend_output_state *states, size_t states_len) {
+	for (size_t i = 0; i < states_len; i++) {
+		struct wlr_output *output = states[i].output;
+		if (output->backend != backend && !wlr_backend_is_multi(backend)) {
+			wlr_log(WLR_ERROR, "Output %s doesn't belong to the backend",
+				output->name);
+			return false;
+		}
+		for (size_t j = 0; j < i; j++) {
+			if (states[j].output == output) {
+				wlr_log(WLR_ERROR, "Output %s appears multiple times in "
+					"the same commit", output->name);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * Returns the backend which can apply all states in a single operation, or
+ * NULL if the outputs need to be committed one after the other.
+ */
+static struct wlr_backend *get_atomic_backend(
+		const struct wlr_backend_output_state *states, size_t states_len) {
+	struct wlr_backend *backend = states[0].output->backend;
+	for (size_t i = 1; i < states_len; i++) {
+		if (states[i].output->backend != backend) {
+			return NULL;
+		}
+	}
+
+	if (!backend->features.atomic_commit || backend->impl->test == NULL ||
+			backend->impl->commit == NULL) {
+		return NULL;
+	}
+	return backend;
+}
+
+static void finish_pending_states(struct wlr_backend_output_state *pending,
+		bool *new_back_buffers, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		if (new_back_buffers[i]) {
+			wlr_buffer_unlock(pending[i].base.buffer);
+		}
+	}
+	free(pending);
+	free(new_back_buffers);
+}
+
+static bool prepare_pending_states(
+		const struct wlr_backend_output_state *states, size_t states_len,
+		struct wlr_backend_output_state **pending_ptr,
+		bool **new_back_buffers_ptr) {
+	struct wlr_backend_output_state *pending =
+		calloc(states_len, sizeof(*pending));
+	bool *new_back_buffers = calloc(states_len, sizeof(*new_back_buffers));
+	if (pending == NULL || new_back_buffers == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		free(pending);
+		free(new_back_buffers);
+		return false;
+	}
+
+	for (size_t i = 0; i < states_len; i++) {
+		pending[i].output = states[i].output;
+		if (!output_prepare_commit(states[i].output, &states[i].base,
+				&pending[i].base, &new_back_buffers[i])) {
+			finish_pending_states(pending, new_back_buffers, i);
+			return false;
+		}
+	}
+
+	*pending_ptr = pending;
+	*new_back_buffers_ptr = new_back_buffers;
+	return true;
+}
+
+static bool test_sequential(const struct wlr_backend_output_state *states,
+		size_t states_len) {
+	for (size_t i = 0; i < states_len; i++) {
+		if (!wlr_output_test_state(states[i].output, &states[i].base)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool wlr_backend_test(struct wlr_backend *backend,
+		const struct wlr_backend_output_state *states, size_t states_len) {
+	if (states_len == 0) {
+		return true;
+	}
+	if (!check_output_states(backend, states, states_len)) {
+		return false;
+	}
+
+	struct wlr_backend *atomic_backend = get_atomic_backend(states, states_len);
+	if (atomic_backend == NULL) {
+		return test_sequential(states, states_len);
+	}
+
+	struct wlr_backend_output_state *pending;
+	bool *new_back_buffers;
+	if (!prepare_pending_states(states, states_len, &pending,
+			&new_back_buffers)) {
+		return false;
+	}
+
+	bool ok = atomic_backend->impl->test(atomic_backend, pending, states_len);
+	finish_pending_states(pending, new_back_buffers, states_len);
+	return ok;
+}
+
+bool wlr_backend_commit(struct wlr_backend *backend,
+		const struct wlr_backend_output_state *states, size_t states_len) {
+	if (states_len == 0) {
+		return true;
+	}
+	if (!check_output_states(backend, states, states_len)) {
+		return false;
+	}
+
+	struct wlr_backend *atomic_backend = get_atomic_backend(states, states_len);
+	if (atomic_backend == NULL) {
+		if (!test_sequential(states, states_len)) {
+			return false;
+		}
+		for (size_t i = 0; i < states_len; i++) {
+			if (!wlr_output_commit_state(states[i].output, &states[i].base)) {
+				wlr_log(WLR_ERROR, "Failed to commit output %s, %zu of %zu "
+					"output states have been applied",
+					states[i].output->name, i, states_len);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	struct wlr_backend_output_state *pending;
+	bool *new_back_buffers;
+	if (!prepare_pending_states(states, states_len, &pending,
+			&new_back_buffers)) {
+		return false;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	for (size_t i = 0; i < states_len; i++) {
+		output_precommit(pending[i].output, &pending[i].base, &now);
+	}
+
+	bool ok = atomic_backend->impl->commit(atomic_backend, pending, states_len);
+	if (ok) {
+		for (size_t i = 0; i < states_len; i++) {
+			output_apply_commit(pending[i].output, &pending[i].base, &now);
+		}
+	}
+
+	finish_pending_states(pending, new_back_buffers, states_len);
+	return ok;
+}
+
 static size_t parse_outputs_env(const char *name) {
 	const char *outputs_str = getenv(name);
 	if (outputs_str == NULL) {
@@ -9,6 +9,10 @@
 #include "backend/drm/iface.h"
 #include "backend/drm/util.h"
 
+#ifndef DRM_CAP_ATOMIC_ASYNC_PAGE_FLIP
+#define DRM_CAP_ATOMIC_ASYNC_PAGE_FLIP 0x15
+#endif
+
 static char *atomic_commit_flags_str(uint32_t flags) {
 	const char *const l[] = {
 		(flags & DRM_MODE_PAGE_FLIP_EVENT) ? "PAGE_FLIP_EVENT" : NULL,
@@ -60,18 +64,23 @@ static void atomic_begin(struct atomic *atom) {
 	}
 }
 
-static bool atomic_commit(struct atomic *atom,
+static bool atomic_commit(struct atomic *atom, struct wlr_drm_backend *drm,
 		struct wlr_drm_connector *conn, uint32_t flags) {
-	struct wlr_drm_backend *drm = conn->backend;
 	if (atom->failed) {
 		return false;
 	}
 
 	int ret = drmModeAtomicCommit(drm->fd, atom->req, flags, drm);
 	if (ret != 0) {
-		wlr_drm_conn_log_errno(conn,
-			(flags & DRM_MODE_ATOMIC_TEST_ONLY) ? WLR_DEBUG : WLR_ERROR,
-			"Atomic commit failed");
+		// Failed async page-flips are retried without the flag
+		enum wlr_log_importance verbosity =
+			(flags & (DRM_MODE_ATOMIC_TEST_ONLY | DRM_MODE_PAGE_FLIP_ASYNC)) ?
+			WLR_DEBUG : WLR_ERROR;
+		if (conn != NULL) {
+			wlr_drm_conn_log_errno(conn, verbosity, "Atomic commit failed");
+		} else {
+			wlr_log_errno(verbosity, "Atomic commit failed");
+		}
 		char *flags_str = atomic_commit_flags_str(flags);
 		wlr_log(WLR_DEBUG, "(Atomic commit flags: %s)",
 			flags_str ? flags_str : "<error>");
@@ -233,24 +242,37 @@ static void set_plane_props(struct atomic *atom, struct wlr_drm_backend *drm,
 	atomic_add(atom, id, props->crtc_y, (uint64_t)y);
 }
 
-static bool atomic_crtc_commit(struct wlr_drm_connector *conn,
-		const struct wlr_drm_connector_state *state, uint32_t flags,
-		bool test_only) {
+// Property values computed for a connector before building the request
+struct atomic_crtc_state {
+	const struct wlr_drm_connector_state *state;
+	uint32_t mode_id;
+	uint32_t gamma_lut;
+	uint32_t fb_damage_clips;
+	bool prev_vrr_enabled, vrr_enabled;
+};
+
+static bool atomic_crtc_prepare(struct atomic_crtc_state *crtc_state,
+		const struct wlr_drm_connector_state *state) {
+	struct wlr_drm_connector *conn = state->connector;
 	struct wlr_drm_backend *drm = conn->backend;
 	struct wlr_output *output = &conn->output;
 	struct wlr_drm_crtc *crtc = conn->crtc;
 
-	bool modeset = state->modeset;
-	bool active = state->active;
+	*crtc_state = (struct atomic_crtc_state){
+		.state = state,
+		.mode_id = crtc->mode_id,
+		.gamma_lut = crtc->gamma_lut,
+		.prev_vrr_enabled =
+			output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED,
+	};
+	crtc_state->vrr_enabled = crtc_state->prev_vrr_enabled;
 
-	uint32_t mode_id = crtc->mode_id;
-	if (modeset) {
-		if (!create_mode_blob(drm, conn, state, &mode_id)) {
+	if (state->modeset) {
+		if (!create_mode_blob(drm, conn, state, &crtc_state->mode_id)) {
 			return false;
 		}
 	}
 
-	uint32_t gamma_lut = crtc->gamma_lut;
 	if (state->base->committed & WLR_OUTPUT_STATE_GAMMA_LUT) {
 		// Fallback to legacy gamma interface when gamma properties are not
 		// available (can happen on older Intel GPUs that support gamma but not
@@ -263,13 +285,12 @@ static bool atomic_crtc_commit(struct wlr_drm_connector *conn,
 			}
 		} else {
 			if (!create_gamma_lut_blob(drm, state->base->gamma_lut_size,
-					state->base->gamma_lut, &gamma_lut)) {
+					state->base->gamma_lut, &crtc_state->gamma_lut)) {
 				return false;
 			}
 		}
 	}
 
-	uint32_t fb_damage_clips = 0;
 	if ((state->base->committed & WLR_OUTPUT_STATE_DAMAGE) &&
 			pixman_region32_not_empty(&state->base->damage) &&
 			crtc->primary->props.fb_damage_clips != 0) {
@@ -277,106 +298,237 @@ static bool atomic_crtc_commit(struct wlr_drm_connector *conn,
 		const pixman_box32_t *rects =
 			pixman_region32_rectangles(&state->base->damage, &rects_len);
 		if (drmModeCreatePropertyBlob(drm->fd, rects,
-				sizeof(*rects) * rects_len, &fb_damage_clips) != 0) {
+				sizeof(*rects) * rects_len, &crtc_state->fb_damage_clips) != 0) {
 			wlr_log_errno(WLR_ERROR, "Failed to create FB_DAMAGE_CLIPS property blob");
 		}
 	}
 
-	bool prev_vrr_enabled =
-		output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED;
-	bool vrr_enabled = prev_vrr_enabled;
 	if ((state->base->committed & WLR_OUTPUT_STATE_ADAPTIVE_SYNC_ENABLED)) {
 		if (!drm_connector_supports_vrr(conn)) {
 			return false;
 		}
-		vrr_enabled = state->base->adaptive_sync_enabled;
+		crtc_state->vrr_enabled = state->base->adaptive_sync_enabled;
 	}
 
-	if (test_only) {
-		flags |= DRM_MODE_ATOMIC_TEST_ONLY;
-	}
-	if (modeset) {
-		flags |= DRM_MODE_ATOMIC_ALLOW_MODESET;
-	} else if (!test_only && (state->base->committed & WLR_OUTPUT_STATE_BUFFER)) {
-		// The wlr_output API requires non-modeset commits with a new buffer to
-		// wait for the frame event. However compositors often perform
-		// non-modesets commits without a new buffer without waiting for the
-		// frame event. In that case we need to make the KMS commit blocking,
-		// otherwise the kernel will error out with EBUSY.
-		flags |= DRM_MODE_ATOMIC_NONBLOCK;
+	return true;
+}
+
+static void atomic_crtc_add(struct atomic *atom,
+		const struct atomic_crtc_state *crtc_state, bool async) {
+	const struct wlr_drm_connector_state *state = crtc_state->state;
+	struct wlr_drm_connector *conn = state->connector;
+	struct wlr_drm_backend *drm = conn->backend;
+	struct wlr_drm_crtc *crtc = conn->crtc;
+	bool modeset = state->modeset;
+	bool active = state->active;
+
+	if (async) {
+		// Kernels reject async page-flips setting any other property, even
+		// to its current value
+		atomic_add(atom, crtc->primary->id, crtc->primary->props.fb_id,
+			state->primary_fb->id);
+		return;
 	}
 
-	struct atomic atom;
-	atomic_begin(&atom);
-	atomic_add(&atom, conn->id, conn->props.crtc_id, active ? crtc->id : 0);
+	atomic_add(atom, conn->id, conn->props.crtc_id, active ? crtc->id : 0);
 	if (modeset && active && conn->props.link_status != 0) {
-		atomic_add(&atom, conn->id, conn->props.link_status,
+		atomic_add(atom, conn->id, conn->props.link_status,
 			DRM_MODE_LINK_STATUS_GOOD);
 	}
 	if (active && conn->props.content_type != 0) {
-		atomic_add(&atom, conn->id, conn->props.content_type,
+		atomic_add(atom, conn->id, conn->props.content_type,
 			DRM_MODE_CONTENT_TYPE_GRAPHICS);
 	}
 	if (modeset && active && conn->props.max_bpc != 0 && conn->max_bpc_bounds[1] != 0) {
-		atomic_add(&atom, conn->id, conn->props.max_bpc, pick_max_bpc(conn, state->primary_fb));
+		atomic_add(atom, conn->id, conn->props.max_bpc, pick_max_bpc(conn, state->primary_fb));
 	}
-	atomic_add(&atom, crtc->id, crtc->props.mode_id, mode_id);
-	atomic_add(&atom, crtc->id, crtc->props.active, active);
+	atomic_add(atom, crtc->id, crtc->props.mode_id, crtc_state->mode_id);
+	atomic_add(atom, crtc->id, crtc->props.active, active);
 	if (active) {
 		if (crtc->props.gamma_lut != 0) {
-			atomic_add(&atom, crtc->id, crtc->props.gamma_lut, gamma_lut);
+			atomic_add(atom, crtc->id, crtc->props.gamma_lut,
+				crtc_state->gamma_lut);
 		}
 		if (crtc->props.vrr_enabled != 0) {
-			atomic_add(&atom, crtc->id, crtc->props.vrr_enabled, vrr_enabled);
+			atomic_add(atom, crtc->id, crtc->props.vrr_enabled,
+				crtc_state->vrr_enabled);
 		}
-		set_plane_props(&atom, drm, crtc->primary, state->primary_fb, crtc->id,
+		set_plane_props(atom, drm, crtc->primary, state->primary_fb, crtc->id,
 			0, 0);
 		if (crtc->primary->props.fb_damage_clips != 0) {
-			atomic_add(&atom, crtc->primary->id,
-				crtc->primary->props.fb_damage_clips, fb_damage_clips);
+			atomic_add(atom, crtc->primary->id,
+				crtc->primary->props.fb_damage_clips,
+				crtc_state->fb_damage_clips);
+		}
+		if (state->primary_in_fence_fd >= 0) {
+			atomic_add(atom, crtc->primary->id,
+				crtc->primary->props.in_fence_fd, state->primary_in_fence_fd);
 		}
 		if (crtc->cursor) {
 			if (drm_connector_is_cursor_visible(conn)) {
-				set_plane_props(&atom, drm, crtc->cursor, get_next_cursor_fb(conn),
+				set_plane_props(atom, drm, crtc->cursor, get_next_cursor_fb(conn),
 					crtc->id, conn->cursor_x, conn->cursor_y);
 			} else {
-				plane_disable(&atom, crtc->cursor);
+				plane_disable(atom, crtc->cursor);
 			}
 		}
 	} else {
-		plane_disable(&atom, crtc->primary);
+		plane_disable(atom, crtc->primary);
 		if (crtc->cursor) {
-			plane_disable(&atom, crtc->cursor);
+			plane_disable(atom, crtc->cursor);
 		}
 	}
+}
 
-	bool ok = atomic_commit(&atom, conn, flags);
-	atomic_finish(&atom);
+static void atomic_crtc_finish(struct atomic_crtc_state *crtc_state,
+		bool applied) {
+	struct wlr_drm_connector *conn = crtc_state->state->connector;
+	struct wlr_drm_backend *drm = conn->backend;
+	struct wlr_output *output = &conn->output;
+	struct wlr_drm_crtc *crtc = conn->crtc;
 
-	if (ok && !test_only) {
-		commit_blob(drm, &crtc->mode_id, mode_id);
-		commit_blob(drm, &crtc->gamma_lut, gamma_lut);
+	if (applied) {
+		commit_blob(drm, &crtc->mode_id, crtc_state->mode_id);
+		commit_blob(drm, &crtc->gamma_lut, crtc_state->gamma_lut);
 
-		if (vrr_enabled != prev_vrr_enabled) {
-			output->adaptive_sync_status = vrr_enabled ?
+		if (crtc_state->vrr_enabled != crtc_state->prev_vrr_enabled) {
+			output->adaptive_sync_status = crtc_state->vrr_enabled ?
 				WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED :
 				WLR_OUTPUT_ADAPTIVE_SYNC_DISABLED;
 			wlr_drm_conn_log(conn, WLR_DEBUG, "VRR %s",
-				vrr_enabled ? "enabled" : "disabled");
+				crtc_state->vrr_enabled ? "enabled" : "disabled");
 		}
 	} else {
-		rollback_blob(drm, &crtc->mode_id, mode_id);
-		rollback_blob(drm, &crtc->gamma_lut, gamma_lut);
+		rollback_blob(drm, &crtc->mode_id, crtc_state->mode_id);
+		rollback_blob(drm, &crtc->gamma_lut, crtc_state->gamma_lut);
 	}
 
-	if (fb_damage_clips != 0 &&
-			drmModeDestroyPropertyBlob(drm->fd, fb_damage_clips) != 0) {
+	if (crtc_state->fb_damage_clips != 0 &&
+			drmModeDestroyPropertyBlob(drm->fd, crtc_state->fb_damage_clips) != 0) {
 		wlr_log_errno(WLR_ERROR, "Failed to destroy FB_DAMAGE_CLIPS property blob");
 	}
+}
+
+static bool atomic_commit_crtcs(struct wlr_drm_backend *drm,
+		const struct atomic_crtc_state *crtc_states, size_t states_len,
+		uint32_t flags) {
+	bool async = flags & DRM_MODE_PAGE_FLIP_ASYNC;
+
+	struct atomic atom;
+	atomic_begin(&atom);
+	for (size_t i = 0; i < states_len; i++) {
+		atomic_crtc_add(&atom, &crtc_states[i], async);
+	}
+	struct wlr_drm_connector *conn =
+		states_len == 1 ? crtc_states[0].state->connector : NULL;
+	bool ok = atomic_commit(&atom, drm, conn, flags);
+	atomic_finish(&atom);
+	return ok;
+}
+
+/**
+ * Try an async page-flip, and fall back to a regular one if the kernel
+ * refuses it. *flags is updated with the flags actually used.
+ */
+static bool atomic_commit_async(struct wlr_drm_backend *drm,
+		const struct atomic_crtc_state *crtc_states, size_t states_len,
+		uint32_t *flags) {
+	if (atomic_commit_crtcs(drm, crtc_states, states_len, *flags)) {
+		return true;
+	}
+
+	wlr_log(WLR_DEBUG, "Async page-flip failed, falling back to vsync");
+	*flags &= ~DRM_MODE_PAGE_FLIP_ASYNC;
+	return atomic_commit_crtcs(drm, crtc_states, states_len, *flags);
+}
+
+static bool atomic_device_commit(struct wlr_drm_backend *drm,
+		const struct wlr_drm_connector_state *states, size_t states_len,
+		uint32_t flags, bool test_only) {
+	struct atomic_crtc_state *crtc_states =
+		calloc(states_len, sizeof(*crtc_states));
+	if (crtc_states == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+
+	bool modeset = false;
+	bool page_flip = true;
+	for (size_t i = 0; i < states_len; i++) {
+		modeset |= states[i].modeset;
+		page_flip &= (states[i].base->committed & WLR_OUTPUT_STATE_BUFFER) != 0;
+
+		// Async page-flips only set the primary plane's FB, so they can't
+		// wait for a fence or update the cursor
+		if (states[i].primary_in_fence_fd >= 0 ||
+				states[i].connector->cursor_dirty) {
+			flags &= ~DRM_MODE_PAGE_FLIP_ASYNC;
+		}
+	}
+
+	if (test_only) {
+		flags |= DRM_MODE_ATOMIC_TEST_ONLY;
+	}
+	if (modeset) {
+		flags |= DRM_MODE_ATOMIC_ALLOW_MODESET;
+	} else if (!test_only && page_flip) {
+		// The wlr_output API requires non-modeset commits with a new buffer to
+		// wait for the frame event. However compositors often perform
+		// non-modesets commits without a new buffer without waiting for the
+		// frame event. In that case we need to make the KMS commit blocking,
+		// otherwise the kernel will error out with EBUSY.
+		flags |= DRM_MODE_ATOMIC_NONBLOCK;
+	}
+
+	bool ok = true;
+	size_t prepared = 0;
+	for (; prepared < states_len; prepared++) {
+		if (!atomic_crtc_prepare(&crtc_states[prepared], &states[prepared])) {
+			// Release whatever has been created before the failure
+			prepared++;
+			ok = false;
+			break;
+		}
+	}
+
+	if (ok && (flags & DRM_MODE_PAGE_FLIP_ASYNC)) {
+		ok = atomic_commit_async(drm, crtc_states, states_len, &flags);
+	} else if (ok) {
+		ok = atomic_commit_crtcs(drm, crtc_states, states_len, flags);
+	}
+
+	if (ok && !test_only) {
+		for (size_t i = 0; i < states_len; i++) {
+			states[i].connector->page_flip_async =
+				(flags & DRM_MODE_PAGE_FLIP_ASYNC) != 0;
+		}
+	}
+
+	for (size_t i = 0; i < prepared; i++) {
+		atomic_crtc_finish(&crtc_states[i], ok && !test_only);
+	}
+	free(crtc_states);
 
 	return ok;
 }
 
+static bool atomic_crtc_commit(struct wlr_drm_connector *conn,
+		const struct wlr_drm_connector_state *state, uint32_t flags,
+		bool test_only) {
+	return atomic_device_commit(conn->backend, state, 1, flags, test_only);
+}
+
+static bool atomic_init(struct wlr_drm_backend *drm) {
+	uint64_t cap;
+	drm->supports_tearing_page_flips =
+		drmGetCap(drm->fd, DRM_CAP_ATOMIC_ASYNC_PAGE_FLIP, &cap) == 0 && cap == 1;
+	wlr_log(WLR_DEBUG, "Atomic async page-flips %s",
+		drm->supports_tearing_page_flips ? "supported" : "unsupported");
+	return true;
+}
+
 const struct wlr_drm_interface atomic_iface = {
+	.init = atomic_init,
 	.crtc_commit = atomic_crtc_commit,
+	.commit = atomic_device_commit,
 };
@@ -93,6 +93,18 @@ static uint32_t drm_backend_get_buffer_caps(struct wlr_backend *backend) {
 	return WLR_BUFFER_CAP_DMABUF;
 }
 
+static bool backend_test(struct wlr_backend *backend,
+		const struct wlr_backend_output_state *states, size_t states_len) {
+	struct wlr_drm_backend *drm = get_drm_backend_from_backend(backend);
+	return drm_commit(drm, states, states_len, true);
+}
+
+static bool backend_commit(struct wlr_backend *backend,
+		const struct wlr_backend_output_state *states, size_t states_len) {
+	struct wlr_drm_backend *drm = get_drm_backend_from_backend(backend);
+	return drm_commit(drm, states, states_len, false);
+}
+
 static const struct wlr_backend_impl backend_impl = {
 	.start = backend_start,
 	.destroy = backend_destroy,
@@ -100,6 +112,8 @@ static const struct wlr_backend_impl backend_impl = {
 	.get_drm_fd = backend_get_drm_fd,
 	.get_drm_render_fd = backend_get_drm_render_fd,
 	.get_buffer_caps = drm_backend_get_buffer_caps,
+	.test = backend_test,
+	.commit = backend_commit,
 };
 
 bool wlr_backend_is_drm(struct wlr_backend *b) {
@@ -113,6 +127,7 @@ static void handle_session_active(struct wl_listener *listener, void *data) {
 
 	if (session->active) {
 		wlr_log(WLR_INFO, "DRM fd resumed");
+		drm->test_generation++;
 		scan_drm_connectors(drm, NULL);
 
 		// The previous DRM master leaves KMS in an undefined state. We need
@@ -163,6 +178,9 @@ static void handle_dev_change(struct wl_listener *listener, void *data) {
 		return;
 	}
 
+	// Connector and lease changes may affect cached test results
+	drm->test_generation++;
+
 	switch (change->type) {
 	case WLR_DEVICE_HOTPLUG:
 		wlr_log(WLR_DEBUG, "Received hotplug event for %s", drm->name);
@@ -274,6 +292,10 @@ struct wlr_backend *wlr_drm_backend_create(struct wl_display *display,
 		goto error_event;
 	}
 
+	// Secondary GPUs need a blit per output, keep committing them one by one
+	drm->backend.features.atomic_commit =
+		drm->iface->commit != NULL && drm->parent == NULL;
+
 	if (!init_drm_resources(drm)) {
 		goto error_event;
 	}
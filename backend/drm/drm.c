@@ -11,6 +11,7 @@
 #include <string.h>
 #include <strings.h>
 #include <time.h>
+#include <unistd.h>
 #include <wayland-server-core.h>
 #include <wayland-util.h>
 #include <wlr/backend/interface.h>
@@ -407,6 +408,37 @@ static struct wlr_drm_layer *get_or_create_layer(struct wlr_drm_backend *drm,
 	return layer;
 }
 
+static void drm_crtc_queue_fbs(struct wlr_drm_connector *conn,
+		const struct wlr_drm_connector_state *state) {
+	struct wlr_drm_crtc *crtc = conn->crtc;
+	drm_fb_clear(&crtc->primary->queued_fb);
+	if (state->primary_fb != NULL) {
+		crtc->primary->queued_fb = drm_fb_lock(state->primary_fb);
+	}
+	if (crtc->cursor != NULL) {
+		drm_fb_move(&crtc->cursor->queued_fb, &conn->cursor_pending_fb);
+	}
+
+	struct wlr_drm_layer *layer;
+	wl_list_for_each(layer, &crtc->layers, link) {
+		drm_fb_move(&layer->queued_fb, &layer->pending_fb);
+	}
+}
+
+static void drm_crtc_clear_pending_fbs(struct wlr_drm_connector *conn) {
+	// The set_cursor() hook is a bit special: it's not really synchronized
+	// to commit() or test(). Once set_cursor() returns true, the new
+	// cursor is effectively committed. So don't roll it back here, or we
+	// risk ending up in a state where we don't have a cursor FB but
+	// wlr_drm_connector.cursor_enabled is true.
+	// TODO: fix our output interface to avoid this issue.
+
+	struct wlr_drm_layer *layer;
+	wl_list_for_each(layer, &conn->crtc->layers, link) {
+		drm_fb_clear(&layer->pending_fb);
+	}
+}
+
 static bool drm_crtc_commit(struct wlr_drm_connector *conn,
 		const struct wlr_drm_connector_state *state,
 		uint32_t flags, bool test_only) {
@@ -414,33 +446,11 @@ static bool drm_crtc_commit(struct wlr_drm_connector *conn,
 	assert((flags & ~DRM_MODE_PAGE_FLIP_FLAGS) == 0);
 
 	struct wlr_drm_backend *drm = conn->backend;
-	struct wlr_drm_crtc *crtc = conn->crtc;
 	bool ok = drm->iface->crtc_commit(conn, state, flags, test_only);
 	if (ok && !test_only) {
-		drm_fb_clear(&crtc->primary->queued_fb);
-		if (state->primary_fb != NULL) {
-			crtc->primary->queued_fb = drm_fb_lock(state->primary_fb);
-		}
-		if (crtc->cursor != NULL) {
-			drm_fb_move(&crtc->cursor->queued_fb, &conn->cursor_pending_fb);
-		}
-
-		struct wlr_drm_layer *layer;
-		wl_list_for_each(layer, &crtc->layers, link) {
-			drm_fb_move(&layer->queued_fb, &layer->pending_fb);
-		}
+		drm_crtc_queue_fbs(conn, state);
 	} else {
-		// The set_cursor() hook is a bit special: it's not really synchronized
-		// to commit() or test(). Once set_cursor() returns true, the new
-		// cursor is effectively committed. So don't roll it back here, or we
-		// risk ending up in a state where we don't have a cursor FB but
-		// wlr_drm_connector.cursor_enabled is true.
-		// TODO: fix our output interface to avoid this issue.
-
-		struct wlr_drm_layer *layer;
-		wl_list_for_each(layer, &crtc->layers, link) {
-			drm_fb_clear(&layer->pending_fb);
-		}
+		drm_crtc_clear_pending_fbs(conn);
 	}
 	return ok;
 }
@@ -449,7 +459,9 @@ static void drm_connector_state_init(struct wlr_drm_connector_state *state,
 		struct wlr_drm_connector *conn,
 		const struct wlr_output_state *base) {
 	memset(state, 0, sizeof(*state));
+	state->connector = conn;
 	state->base = base;
+	state->primary_in_fence_fd = -1;
 	state->modeset = base->allow_artifacts;
 	state->active = (base->committed & WLR_OUTPUT_STATE_ENABLED) ?
 		base->enabled : conn->output.enabled;
@@ -487,6 +499,9 @@ static void drm_connector_state_init(struct wlr_drm_connector_state *state,
 
 static void drm_connector_state_finish(struct wlr_drm_connector_state *state) {
 	drm_fb_clear(&state->primary_fb);
+	if (state->primary_in_fence_fd >= 0) {
+		close(state->primary_in_fence_fd);
+	}
 }
 
 static bool drm_connector_state_update_primary_fb(struct wlr_drm_connector *conn,
@@ -545,7 +560,15 @@ static bool drm_connector_state_update_primary_fb(struct wlr_drm_connector *conn
 			goto release_buf;
 		}
 
-		struct wlr_buffer *drm_buf = drm_surface_blit(&plane->mgpu_surf, source_buf);
+		// With atomic, the kernel can wait for the blit to complete before
+		// scanning out the buffer, so we don't need to stall on it
+		int *in_fence_fd = NULL;
+		if (drm->iface == &atomic_iface && plane->props.in_fence_fd != 0) {
+			in_fence_fd = &state->primary_in_fence_fd;
+		}
+
+		struct wlr_buffer *drm_buf = drm_surface_blit(&plane->mgpu_surf,
+			source_buf, in_fence_fd);
 		if (drm_buf == NULL) {
 			ok = false;
 			goto release_buf;
@@ -600,6 +623,72 @@ static bool drm_connector_set_pending_layer_fbs(struct wlr_drm_connector *conn,
 	return true;
 }
 
+/**
+ * Fill the key of a test request. Returns false if the result of the request
+ * can't be cached: only plain page-flips on the atomic interface are.
+ */
+static bool drm_connector_get_test_key(struct wlr_drm_connector *conn,
+		const struct wlr_drm_connector_state *state,
+		struct wlr_drm_test_key *key) {
+	struct wlr_drm_backend *drm = conn->backend;
+	if (drm->iface != &atomic_iface || conn->crtc == NULL ||
+			state->modeset || state->primary_fb == NULL ||
+			(state->base->committed & COMMIT_OUTPUT_STATE) !=
+			WLR_OUTPUT_STATE_BUFFER) {
+		return false;
+	}
+
+	struct wlr_dmabuf_attributes attribs;
+	if (!wlr_buffer_get_dmabuf(state->primary_fb->wlr_buf, &attribs)) {
+		return false;
+	}
+
+	// Zero the padding, keys are compared with memcmp()
+	memset(key, 0, sizeof(*key));
+	key->generation = drm->test_generation;
+	key->crtc_id = conn->crtc->id;
+	key->format = attribs.format;
+	key->modifier = attribs.modifier;
+	key->width = attribs.width;
+	key->height = attribs.height;
+	key->n_planes = attribs.n_planes;
+	for (int i = 0; i < attribs.n_planes; i++) {
+		key->offset[i] = attribs.offset[i];
+		key->stride[i] = attribs.stride[i];
+	}
+
+	if (conn->crtc->cursor != NULL && drm_connector_is_cursor_visible(conn)) {
+		struct wlr_drm_fb *cursor_fb = get_next_cursor_fb(conn);
+		key->cursor_visible = true;
+		key->cursor_fb_id = cursor_fb != NULL ? cursor_fb->id : 0;
+		key->cursor_x = conn->cursor_x;
+		key->cursor_y = conn->cursor_y;
+	}
+
+	return true;
+}
+
+static const struct wlr_drm_test_result *drm_connector_get_test_result(
+		struct wlr_drm_connector *conn, const struct wlr_drm_test_key *key) {
+	for (size_t i = 0; i < DRM_TEST_CACHE_SIZE; i++) {
+		const struct wlr_drm_test_result *result = &conn->test_cache[i];
+		if (result->valid && memcmp(&result->key, key, sizeof(*key)) == 0) {
+			return result;
+		}
+	}
+	return NULL;
+}
+
+static void drm_connector_add_test_result(struct wlr_drm_connector *conn,
+		const struct wlr_drm_test_key *key, bool ok) {
+	conn->test_cache[conn->test_cache_next] = (struct wlr_drm_test_result){
+		.valid = true,
+		.ok = ok,
+		.key = *key,
+	};
+	conn->test_cache_next = (conn->test_cache_next + 1) % DRM_TEST_CACHE_SIZE;
+}
+
 static bool drm_connector_alloc_crtc(struct wlr_drm_connector *conn);
 
 static bool drm_connector_test(struct wlr_output *output,
@@ -682,8 +771,23 @@ static bool drm_connector_test(struct wlr_output *output,
 		}
 	}
 
+	struct wlr_drm_test_key key;
+	bool cacheable = drm_connector_get_test_key(conn, &pending, &key);
+	if (cacheable) {
+		const struct wlr_drm_test_result *result =
+			drm_connector_get_test_result(conn, &key);
+		if (result != NULL) {
+			ok = result->ok;
+			goto out;
+		}
+	}
+
 	ok = drm_crtc_commit(conn, &pending, 0, true);
 
+	if (cacheable) {
+		drm_connector_add_test_result(conn, &key, ok);
+	}
+
 out:
 	drm_connector_state_finish(&pending);
 	return ok;
@@ -715,6 +819,50 @@ bool drm_connector_supports_vrr(struct wlr_drm_connector *conn) {
 	return true;
 }
 
+/**
+ * Update the connector after its state has been committed to KMS.
+ */
+static void drm_connector_apply_commit(struct wlr_drm_connector *conn,
+		const struct wlr_drm_connector_state *pending, bool page_flip) {
+	if (pending->modeset || (pending->base->committed & COMMIT_OUTPUT_STATE &
+			~WLR_OUTPUT_STATE_BUFFER) != 0) {
+		// This may change what later page-flips can do, on any CRTC
+		conn->backend->test_generation++;
+	}
+	// The cursor state is part of every commit
+	conn->cursor_dirty = false;
+
+	if (!pending->active) {
+		drm_plane_finish_surface(conn->crtc->primary);
+		drm_plane_finish_surface(conn->crtc->cursor);
+		drm_fb_clear(&conn->cursor_pending_fb);
+
+		conn->cursor_enabled = false;
+		conn->crtc = NULL;
+	}
+	if (pending->base->committed & WLR_OUTPUT_STATE_MODE) {
+		struct wlr_output_mode *mode = NULL;
+		switch (pending->base->mode_type) {
+		case WLR_OUTPUT_STATE_MODE_FIXED:
+			mode = pending->base->mode;
+			break;
+		case WLR_OUTPUT_STATE_MODE_CUSTOM:
+			mode = wlr_drm_connector_add_mode(&conn->output, &pending->mode);
+			break;
+		}
+		wlr_output_update_mode(&conn->output, mode);
+	}
+	if (page_flip) {
+		conn->pending_page_flip_crtc = conn->crtc->id;
+
+		// wlr_output's API guarantees that submitting a buffer will schedule a
+		// frame event. However the DRM backend will also schedule a frame event
+		// when performing a modeset. Set frame_pending to true so that
+		// wlr_output_schedule_frame doesn't trigger a synthetic frame event.
+		conn->output.frame_pending = true;
+	}
+}
+
 bool drm_connector_commit_state(struct wlr_drm_connector *conn,
 		const struct wlr_output_state *base) {
 	struct wlr_drm_backend *drm = conn->backend;
@@ -766,6 +914,13 @@ bool drm_connector_commit_state(struct wlr_drm_connector *conn,
 	if (pending.modeset && pending.active) {
 		flags |= DRM_MODE_PAGE_FLIP_EVENT;
 	}
+	// Async page-flips can't change anything but the primary plane's FB
+	if ((pending.base->committed & COMMIT_OUTPUT_STATE) ==
+			WLR_OUTPUT_STATE_BUFFER && pending.base->tearing_page_flip &&
+			!pending.modeset && pending.active &&
+			drm->supports_tearing_page_flips) {
+		flags |= DRM_MODE_PAGE_FLIP_ASYNC;
+	}
 	if (pending.base->committed & WLR_OUTPUT_STATE_LAYERS) {
 		if (!drm_connector_set_pending_layer_fbs(conn, pending.base)) {
 			return false;
@@ -784,38 +939,12 @@ bool drm_connector_commit_state(struct wlr_drm_connector *conn,
 
 	ok = drm_crtc_commit(conn, &pending, flags, false);
 	if (!ok) {
+		// Don't trust earlier test results anymore
+		drm->test_generation++;
 		goto out;
 	}
 
-	if (!pending.active) {
-		drm_plane_finish_surface(conn->crtc->primary);
-		drm_plane_finish_surface(conn->crtc->cursor);
-		drm_fb_clear(&conn->cursor_pending_fb);
-
-		conn->cursor_enabled = false;
-		conn->crtc = NULL;
-	}
-	if (pending.base->committed & WLR_OUTPUT_STATE_MODE) {
-		struct wlr_output_mode *mode = NULL;
-		switch (pending.base->mode_type) {
-		case WLR_OUTPUT_STATE_MODE_FIXED:
-			mode = pending.base->mode;
-			break;
-		case WLR_OUTPUT_STATE_MODE_CUSTOM:
-			mode = wlr_drm_connector_add_mode(&conn->output, &pending.mode);
-			break;
-		}
-		wlr_output_update_mode(&conn->output, mode);
-	}
-	if (flags & DRM_MODE_PAGE_FLIP_EVENT) {
-		conn->pending_page_flip_crtc = conn->crtc->id;
-
-		// wlr_output's API guarantees that submitting a buffer will schedule a
-		// frame event. However the DRM backend will also schedule a frame event
-		// when performing a modeset. Set frame_pending to true so that
-		// wlr_output_schedule_frame doesn't trigger a synthetic frame event.
-		conn->output.frame_pending = true;
-	}
+	drm_connector_apply_commit(conn, &pending, flags & DRM_MODE_PAGE_FLIP_EVENT);
 
 out:
 	drm_connector_state_finish(&pending);
@@ -833,6 +962,167 @@ static bool drm_connector_commit(struct wlr_output *output,
 	return drm_connector_commit_state(conn, state);
 }
 
+/**
+ * Check a connector state and acquire everything needed to commit it along
+ * with other connectors in a single request.
+ */
+static bool drm_connector_prepare_commit(struct wlr_drm_connector_state *pending,
+		bool test_only) {
+	struct wlr_drm_connector *conn = pending->connector;
+	const struct wlr_output_state *base = pending->base;
+
+	if (pending->active) {
+		if ((base->committed &
+				(WLR_OUTPUT_STATE_ENABLED | WLR_OUTPUT_STATE_MODE)) &&
+				!(base->committed & WLR_OUTPUT_STATE_BUFFER)) {
+			wlr_drm_conn_log(conn, WLR_DEBUG,
+				"Can't enable an output without a buffer");
+			return false;
+		}
+
+		if (!drm_connector_alloc_crtc(conn)) {
+			wlr_drm_conn_log(conn, WLR_DEBUG,
+				"No CRTC available for this connector");
+			return false;
+		}
+	}
+
+	if ((base->committed & WLR_OUTPUT_STATE_ADAPTIVE_SYNC_ENABLED) &&
+			base->adaptive_sync_enabled &&
+			!drm_connector_supports_vrr(conn)) {
+		return false;
+	}
+
+	if (base->committed & WLR_OUTPUT_STATE_BUFFER) {
+		if (!drm_connector_state_update_primary_fb(conn, pending)) {
+			return false;
+		}
+		if (!test_only && conn->pending_page_flip_crtc && !pending->modeset) {
+			wlr_drm_conn_log(conn, WLR_ERROR, "Failed to page-flip output: "
+				"a page-flip is already pending");
+			return false;
+		}
+	}
+	if (base->committed & WLR_OUTPUT_STATE_LAYERS) {
+		if (!drm_connector_set_pending_layer_fbs(conn, base)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool drm_commit(struct wlr_drm_backend *drm,
+		const struct wlr_backend_output_state *states, size_t states_len,
+		bool test_only) {
+	assert(drm->iface->commit != NULL && drm->parent == NULL);
+
+	if (!drm->session->active) {
+		return false;
+	}
+
+	struct wlr_drm_connector_state *pending =
+		calloc(states_len, sizeof(*pending));
+	if (pending == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+
+	bool ok = false;
+	size_t pending_len = 0;
+	for (size_t i = 0; i < states_len; i++) {
+		struct wlr_drm_connector *conn =
+			get_drm_connector_from_output(states[i].output);
+		const struct wlr_output_state *base = &states[i].base;
+
+		uint32_t unsupported = base->committed & ~SUPPORTED_OUTPUT_STATE;
+		if (unsupported != 0) {
+			wlr_log(WLR_DEBUG, "Unsupported output state fields: 0x%"PRIx32,
+				unsupported);
+			goto out;
+		}
+
+		if ((base->committed & COMMIT_OUTPUT_STATE) == 0) {
+			// This commit doesn't change the KMS state
+			continue;
+		}
+
+		if ((base->committed & WLR_OUTPUT_STATE_ENABLED) && base->enabled &&
+				conn->output.current_mode == NULL &&
+				!(base->committed & WLR_OUTPUT_STATE_MODE)) {
+			wlr_drm_conn_log(conn, WLR_DEBUG,
+				"Can't enable an output without a mode");
+			goto out;
+		}
+
+		struct wlr_drm_connector_state *state = &pending[pending_len++];
+		drm_connector_state_init(state, conn, base);
+
+		if (!state->active && conn->crtc == NULL) {
+			// Disabling an already-disabled connector
+			drm_connector_state_finish(state);
+			pending_len--;
+			continue;
+		}
+
+		if (!drm_connector_prepare_commit(state, test_only)) {
+			goto out;
+		}
+	}
+
+	if (pending_len == 0) {
+		ok = true;
+		goto out;
+	}
+
+	uint32_t flags = 0;
+	for (size_t i = 0; i < pending_len; i++) {
+		struct wlr_drm_connector_state *state = &pending[i];
+		if ((state->base->committed & WLR_OUTPUT_STATE_BUFFER) ||
+				(state->modeset && state->active)) {
+			flags |= DRM_MODE_PAGE_FLIP_EVENT;
+		}
+
+		if (state->modeset && !test_only) {
+			if (state->active) {
+				wlr_drm_conn_log(state->connector, WLR_INFO,
+					"Modesetting with %dx%d @ %.3f Hz",
+					state->mode.hdisplay, state->mode.vdisplay,
+					(float)calculate_refresh_rate(&state->mode) / 1000);
+			} else {
+				wlr_drm_conn_log(state->connector, WLR_INFO, "Turning off");
+			}
+		}
+	}
+
+	ok = drm->iface->commit(drm, pending, pending_len, test_only ? 0 : flags,
+		test_only);
+	if (!ok && !test_only) {
+		drm->test_generation++;
+	}
+	if (ok && !test_only) {
+		for (size_t i = 0; i < pending_len; i++) {
+			struct wlr_drm_connector_state *state = &pending[i];
+			bool page_flip =
+				(state->base->committed & WLR_OUTPUT_STATE_BUFFER) ||
+				(state->modeset && state->active);
+			drm_crtc_queue_fbs(state->connector, state);
+			drm_connector_apply_commit(state->connector, state, page_flip);
+		}
+	}
+
+out:
+	for (size_t i = 0; i < pending_len; i++) {
+		struct wlr_drm_connector_state *state = &pending[i];
+		if (!(ok && !test_only) && state->connector->crtc != NULL) {
+			drm_crtc_clear_pending_fbs(state->connector);
+		}
+		drm_connector_state_finish(state);
+	}
+	free(pending);
+	return ok;
+}
+
 size_t drm_crtc_get_gamma_lut_size(struct wlr_drm_backend *drm,
 		struct wlr_drm_crtc *crtc) {
 	if (crtc->props.gamma_lut_size == 0 || drm->iface == &legacy_iface) {
@@ -956,6 +1246,7 @@ static bool drm_connector_set_cursor(struct wlr_output *output,
 		conn->cursor_hotspot_x = hotspot_x;
 		conn->cursor_hotspot_y = hotspot_y;
 
+		conn->cursor_dirty = true;
 		wlr_output_update_needs_frame(output);
 	}
 
@@ -983,7 +1274,7 @@ static bool drm_connector_set_cursor(struct wlr_output *output,
 				return false;
 			}
 
-			local_buf = drm_surface_blit(&plane->mgpu_surf, buffer);
+			local_buf = drm_surface_blit(&plane->mgpu_surf, buffer, NULL);
 			if (local_buf == NULL) {
 				return false;
 			}
@@ -1003,6 +1294,7 @@ static bool drm_connector_set_cursor(struct wlr_output *output,
 		conn->cursor_height = buffer->height;
 	}
 
+	conn->cursor_dirty = true;
 	wlr_output_update_needs_frame(output);
 	return true;
 }
@@ -1032,6 +1324,7 @@ static bool drm_connector_move_cursor(struct wlr_output *output,
 
 	conn->cursor_x = box.x;
 	conn->cursor_y = box.y;
+	conn->cursor_dirty = true;
 
 	wlr_output_update_needs_frame(output);
 	return true;
@@ -1196,6 +1489,8 @@ static void realloc_crtcs(struct wlr_drm_backend *drm,
 		struct wlr_drm_connector *want_conn) {
 	assert(drm->num_crtcs > 0);
 
+	drm->test_generation++;
+
 	size_t num_connectors = wl_list_length(&drm->connectors);
 	if (num_connectors == 0) {
 		return;
@@ -1355,6 +1650,15 @@ static struct wlr_drm_connector *create_drm_connector(struct wlr_drm_backend *dr
 	snprintf(wlr_conn->name, sizeof(wlr_conn->name),
 		"%s-%"PRIu32, conn_name, drm_conn->connector_type_id);
 
+	// Property IDs don't change during the connector's lifetime, so they only
+	// need to be fetched once
+	if (!get_drm_connector_props(drm->fd, wlr_conn->id, &wlr_conn->props)) {
+		wlr_log(WLR_ERROR, "Failed to get properties of connector '%s'",
+			wlr_conn->name);
+		free(wlr_conn);
+		return NULL;
+	}
+
 	wlr_conn->possible_crtcs =
 		drmModeConnectorGetPossibleCrtcs(drm->fd, drm_conn);
 	if (wlr_conn->possible_crtcs == 0) {
@@ -1425,10 +1729,6 @@ static bool connect_drm_connector(struct wlr_drm_connector *wlr_conn,
 		wlr_log(WLR_ERROR, "Unknown subpixel value: %d", (int)drm_conn->subpixel);
 	}
 
-	if (!get_drm_connector_props(drm->fd, wlr_conn->id, &wlr_conn->props)) {
-		return false;
-	}
-
 	uint64_t non_desktop;
 	if (get_drm_prop(drm->fd, wlr_conn->id,
 				wlr_conn->props.non_desktop, &non_desktop)) {
@@ -1525,11 +1825,104 @@ static bool connect_drm_connector(struct wlr_drm_connector *wlr_conn,
 
 static void disconnect_drm_connector(struct wlr_drm_connector *conn);
 
+/**
+ * Update the status of a connector from freshly probed state. Returns true if
+ * the connector has just been connected and needs a new_output event.
+ */
+static bool update_drm_connector(struct wlr_drm_connector *wlr_conn,
+		const drmModeConnector *drm_conn) {
+	struct wlr_drm_backend *drm = wlr_conn->backend;
+
+	if (wlr_conn->props.link_status != 0) {
+		uint64_t link_status;
+		if (!get_drm_prop(drm->fd, wlr_conn->id,
+				wlr_conn->props.link_status, &link_status)) {
+			wlr_drm_conn_log(wlr_conn, WLR_ERROR,
+				"Failed to get link status prop");
+			return false;
+		}
+
+		if (link_status == DRM_MODE_LINK_STATUS_BAD) {
+			// We need to reload our list of modes and force a modeset
+			wlr_drm_conn_log(wlr_conn, WLR_INFO, "Bad link detected");
+			disconnect_drm_connector(wlr_conn);
+		}
+	}
+
+	if (wlr_conn->status == DRM_MODE_DISCONNECTED &&
+			drm_conn->connection == DRM_MODE_CONNECTED) {
+		wlr_log(WLR_INFO, "'%s' connected", wlr_conn->name);
+		if (!connect_drm_connector(wlr_conn, drm_conn)) {
+			wlr_drm_conn_log(wlr_conn, WLR_ERROR, "Failed to connect DRM connector");
+			return false;
+		}
+		return true;
+	} else if (wlr_conn->status == DRM_MODE_CONNECTED &&
+			drm_conn->connection != DRM_MODE_CONNECTED) {
+		wlr_log(WLR_INFO, "'%s' disconnected", wlr_conn->name);
+		disconnect_drm_connector(wlr_conn);
+	}
+
+	return false;
+}
+
+static void finish_drm_connectors_scan(struct wlr_drm_backend *drm,
+		struct wlr_drm_connector **new_outputs, size_t new_outputs_len) {
+	realloc_crtcs(drm, NULL);
+
+	for (size_t i = 0; i < new_outputs_len; ++i) {
+		struct wlr_drm_connector *conn = new_outputs[i];
+
+		wlr_drm_conn_log(conn, WLR_INFO, "Requesting modeset");
+		wl_signal_emit_mutable(&drm->backend.events.new_output,
+			&conn->output);
+	}
+}
+
+/**
+ * Probe only the connector a hotplug event refers to, without listing all
+ * of the device's resources. Returns false if the connector isn't known yet
+ * or has gone away, in which case the connector list has changed and needs to
+ * be refreshed.
+ */
+static bool scan_single_drm_connector(struct wlr_drm_backend *drm,
+		uint32_t conn_id) {
+	struct wlr_drm_connector *c, *wlr_conn = NULL;
+	wl_list_for_each(c, &drm->connectors, link) {
+		if (c->id == conn_id) {
+			wlr_conn = c;
+			break;
+		}
+	}
+	if (wlr_conn == NULL) {
+		return false;
+	}
+
+	drmModeConnector *drm_conn = drmModeGetConnector(drm->fd, conn_id);
+	if (drm_conn == NULL) {
+		return false;
+	}
+
+	bool connected = update_drm_connector(wlr_conn, drm_conn);
+	drmModeFreeConnector(drm_conn);
+
+	finish_drm_connectors_scan(drm, &wlr_conn, connected ? 1 : 0);
+	return true;
+}
+
 void scan_drm_connectors(struct wlr_drm_backend *drm,
 		struct wlr_device_hotplug_event *event) {
+	// Only this connector is probed if non-zero, the others are just checked
+	// for existence
+	uint32_t probe_id = 0;
 	if (event != NULL && event->connector_id != 0) {
 		wlr_log(WLR_INFO, "Scanning DRM connector %"PRIu32" on %s",
 			event->connector_id, drm->name);
+		if (scan_single_drm_connector(drm, event->connector_id)) {
+			return;
+		}
+		wlr_log(WLR_DEBUG, "Connector list changed, refreshing it");
+		probe_id = event->connector_id;
 	} else {
 		wlr_log(WLR_INFO, "Scanning DRM connectors on %s", drm->name);
 	}
@@ -1561,10 +1954,10 @@ void scan_drm_connectors(struct wlr_drm_backend *drm,
 			}
 		}
 
-		// If the hotplug event contains a connector ID, ignore any other
-		// connector.
-		if (event != NULL && event->connector_id != 0 &&
-				event->connector_id != conn_id) {
+		// drmModeGetConnector() forces a probe, which is slow. Other
+		// connectors get their own hotplug event, or will be picked up by the
+		// next full scan.
+		if (probe_id != 0 && probe_id != conn_id) {
 			if (wlr_conn != NULL) {
 				seen[index] = true;
 			}
@@ -1580,6 +1973,7 @@ void scan_drm_connectors(struct wlr_drm_backend *drm,
 		if (!wlr_conn) {
 			wlr_conn = create_drm_connector(drm, drm_conn);
 			if (wlr_conn == NULL) {
+				drmModeFreeConnector(drm_conn);
 				continue;
 			}
 			wlr_log(WLR_INFO, "Found connector '%s'", wlr_conn->name);
@@ -1587,36 +1981,8 @@ void scan_drm_connectors(struct wlr_drm_backend *drm,
 			seen[index] = true;
 		}
 
-		// This can only happen *after* hotplug, since we haven't read the
-		// connector properties yet
-		if (wlr_conn->props.link_status != 0) {
-			uint64_t link_status;
-			if (!get_drm_prop(drm->fd, wlr_conn->id,
-					wlr_conn->props.link_status, &link_status)) {
-				wlr_drm_conn_log(wlr_conn, WLR_ERROR,
-					"Failed to get link status prop");
-				continue;
-			}
-
-			if (link_status == DRM_MODE_LINK_STATUS_BAD) {
-				// We need to reload our list of modes and force a modeset
-				wlr_drm_conn_log(wlr_conn, WLR_INFO, "Bad link detected");
-				disconnect_drm_connector(wlr_conn);
-			}
-		}
-
-		if (wlr_conn->status == DRM_MODE_DISCONNECTED &&
-				drm_conn->connection == DRM_MODE_CONNECTED) {
-			wlr_log(WLR_INFO, "'%s' connected", wlr_conn->name);
-			if (!connect_drm_connector(wlr_conn, drm_conn)) {
-				wlr_drm_conn_log(wlr_conn, WLR_ERROR, "Failed to connect DRM connector");
-				continue;
-			}
+		if (update_drm_connector(wlr_conn, drm_conn)) {
 			new_outputs[new_outputs_len++] = wlr_conn;
-		} else if (wlr_conn->status == DRM_MODE_CONNECTED &&
-				drm_conn->connection != DRM_MODE_CONNECTED) {
-			wlr_log(WLR_INFO, "'%s' disconnected", wlr_conn->name);
-			disconnect_drm_connector(wlr_conn);
 		}
 
 		drmModeFreeConnector(drm_conn);
@@ -1638,15 +2004,7 @@ void scan_drm_connectors(struct wlr_drm_backend *drm,
 		destroy_drm_connector(conn);
 	}
 
-	realloc_crtcs(drm, NULL);
-
-	for (size_t i = 0; i < new_outputs_len; ++i) {
-		struct wlr_drm_connector *conn = new_outputs[i];
-
-		wlr_drm_conn_log(conn, WLR_INFO, "Requesting modeset");
-		wl_signal_emit_mutable(&drm->backend.events.new_output,
-			&conn->output);
-	}
+	finish_drm_connectors_scan(drm, new_outputs, new_outputs_len);
 }
 
 void scan_drm_leases(struct wlr_drm_backend *drm) {
@@ -1722,8 +2080,11 @@ static void handle_page_flip(int fd, unsigned seq,
 		drm_fb_move(&layer->current_fb, &layer->queued_fb);
 	}
 
-	uint32_t present_flags = WLR_OUTPUT_PRESENT_VSYNC |
+	uint32_t present_flags =
 		WLR_OUTPUT_PRESENT_HW_CLOCK | WLR_OUTPUT_PRESENT_HW_COMPLETION;
+	if (!conn->page_flip_async) {
+		present_flags |= WLR_OUTPUT_PRESENT_VSYNC;
+	}
 	/* Don't report ZERO_COPY in multi-gpu situations, because we had to copy
 	 * data between the GPUs, even if we were using the direct scanout
 	 * interface.
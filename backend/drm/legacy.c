@@ -175,11 +175,19 @@ static bool legacy_crtc_commit(struct wlr_drm_connector *conn,
 	}
 
 	if (flags & DRM_MODE_PAGE_FLIP_EVENT) {
-		if (drmModePageFlip(drm->fd, crtc->id, fb_id,
-				DRM_MODE_PAGE_FLIP_EVENT, drm)) {
+		uint32_t page_flip_flags = flags & DRM_MODE_PAGE_FLIP_FLAGS;
+		int ret = drmModePageFlip(drm->fd, crtc->id, fb_id, page_flip_flags, drm);
+		if (ret != 0 && (page_flip_flags & DRM_MODE_PAGE_FLIP_ASYNC)) {
+			wlr_drm_conn_log_errno(conn, WLR_DEBUG, "Async page-flip failed, "
+				"falling back to vsync");
+			page_flip_flags &= ~DRM_MODE_PAGE_FLIP_ASYNC;
+			ret = drmModePageFlip(drm->fd, crtc->id, fb_id, page_flip_flags, drm);
+		}
+		if (ret != 0) {
 			wlr_drm_conn_log_errno(conn, WLR_ERROR, "drmModePageFlip failed");
 			return false;
 		}
+		conn->page_flip_async = page_flip_flags & DRM_MODE_PAGE_FLIP_ASYNC;
 	}
 
 	return true;
@@ -227,6 +235,16 @@ bool drm_legacy_crtc_set_gamma(struct wlr_drm_backend *drm,
 	return true;
 }
 
+static bool legacy_init(struct wlr_drm_backend *drm) {
+	uint64_t cap;
+	drm->supports_tearing_page_flips =
+		drmGetCap(drm->fd, DRM_CAP_ASYNC_PAGE_FLIP, &cap) == 0 && cap == 1;
+	wlr_log(WLR_DEBUG, "Legacy async page-flips %s",
+		drm->supports_tearing_page_flips ? "supported" : "unsupported");
+	return true;
+}
+
 const struct wlr_drm_interface legacy_iface = {
+	.init = legacy_init,
 	.crtc_commit = legacy_crtc_commit,
 };
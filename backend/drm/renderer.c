@@ -81,7 +81,7 @@ bool init_drm_surface(struct wlr_drm_surface *surf,
 }
 
 struct wlr_buffer *drm_surface_blit(struct wlr_drm_surface *surf,
-		struct wlr_buffer *buffer) {
+		struct wlr_buffer *buffer, int *sync_file_fd) {
 	struct wlr_renderer *renderer = surf->renderer->wlr_rend;
 
 	if (surf->swapchain->width != buffer->width ||
@@ -123,7 +123,11 @@ struct wlr_buffer *drm_surface_blit(struct wlr_drm_surface *surf,
 	wlr_renderer_clear(renderer, (float[]){ 0.0, 0.0, 0.0, 0.0 });
 	wlr_render_texture_with_matrix(renderer, tex, mat, 1.0f);
 
-	wlr_renderer_end(renderer);
+	if (sync_file_fd != NULL) {
+		*sync_file_fd = renderer_end_with_sync_file(renderer);
+	} else {
+		wlr_renderer_end(renderer);
+	}
 
 	wlr_texture_set_destroy(set);
 
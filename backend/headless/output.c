@@ -5,6 +5,7 @@
 #include <wlr/types/wlr_output_layer.h>
 #include <wlr/util/log.h>
 #include "backend/headless.h"
+#include "util/time.h"
 
 static const uint32_t SUPPORTED_OUTPUT_STATE =
 	WLR_OUTPUT_STATE_BACKEND_OPTIONAL |
@@ -25,7 +26,7 @@ static bool output_set_custom_mode(struct wlr_headless_output *output,
 		refresh = HEADLESS_DEFAULT_REFRESH;
 	}
 
-	output->frame_delay = 1000000 / refresh;
+	output->refresh_nsec = 1000000000000ll / refresh;
 
 	wlr_output_update_custom_mode(&output->wlr_output, width, height, refresh);
 	return true;
@@ -72,14 +73,12 @@ static bool output_commit(struct wlr_output *wlr_output,
 	}
 
 	if (state->committed & WLR_OUTPUT_STATE_BUFFER) {
-		struct wlr_output_event_present present_event = {
-			.commit_seq = wlr_output->commit_seq + 1,
-			.presented = true,
-		};
-		wlr_output_send_present(wlr_output, &present_event);
+		// The buffer is "scanned out" at the next vblank
+		output->present_pending = true;
+		output->present_commit_seq = wlr_output->commit_seq + 1;
 	}
 
-	wl_event_source_timer_update(output->frame_timer, output->frame_delay);
+	headless_output_schedule_vblank(output);
 
 	return true;
 }
@@ -101,9 +100,51 @@ bool wlr_output_is_headless(struct wlr_output *wlr_output) {
 	return wlr_output->impl == &output_impl;
 }
 
+void headless_output_schedule_vblank(struct wlr_headless_output *output) {
+	if (output->next_vblank_nsec != 0) {
+		return;
+	}
+
+	int64_t now = get_current_time_nsec();
+	int64_t refresh = output->refresh_nsec;
+	int64_t since_vblank = now - output->last_vblank_nsec;
+	if (output->last_vblank_nsec == 0 || since_vblank < 0) {
+		output->last_vblank_nsec = now;
+		since_vblank = 0;
+	}
+	output->next_vblank_nsec = output->last_vblank_nsec +
+		(since_vblank / refresh + 1) * refresh;
+
+	// Timers have millisecond granularity, round up so that the vblank has
+	// happened when the timer fires
+	int64_t delay = output->next_vblank_nsec - now;
+	int delay_ms = (delay + 999999) / 1000000;
+	wl_event_source_timer_update(output->frame_timer, delay_ms);
+}
+
 static int signal_frame(void *data) {
 	struct wlr_headless_output *output = data;
-	wlr_output_send_frame(&output->wlr_output);
+	struct wlr_output *wlr_output = &output->wlr_output;
+
+	output->last_vblank_nsec = output->next_vblank_nsec;
+	output->next_vblank_nsec = 0;
+
+	if (output->present_pending) {
+		output->present_pending = false;
+
+		struct timespec when;
+		timespec_from_nsec(&when, output->last_vblank_nsec);
+		struct wlr_output_event_present present_event = {
+			.commit_seq = output->present_commit_seq,
+			.presented = true,
+			.when = &when,
+			.refresh = output->refresh_nsec,
+			.flags = WLR_OUTPUT_PRESENT_VSYNC,
+		};
+		wlr_output_send_present(wlr_output, &present_event);
+	}
+
+	wlr_output_send_frame(wlr_output);
 	return 0;
 }
 
@@ -141,7 +182,7 @@ struct wlr_output *wlr_headless_add_output(struct wlr_backend *wlr_backend,
 	wl_list_insert(&backend->outputs, &output->link);
 
 	if (backend->started) {
-		wl_event_source_timer_update(output->frame_timer, output->frame_delay);
+		headless_output_schedule_vblank(output);
 		wlr_output_update_enabled(wlr_output, true);
 		wl_signal_emit_mutable(&backend->backend.events.new_output, wlr_output);
 	}
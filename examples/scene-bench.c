@@ -0,0 +1,524 @@
+#define _POSIX_C_SOURCE 200809L
+#include <drm_fourcc.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <wayland-server-core.h>
+#include <wlr/backend.h>
+#include <wlr/backend/headless.h>
+#include <wlr/interfaces/wlr_buffer.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/pixman.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/log.h>
+
+/* Non-interactive benchmark of the scene-graph, using the headless backend and
+ * the pixman renderer so that results don't depend on the hardware.
+ *
+ * A synthetic scene is built from the command-line parameters, then the
+ * following operations are timed:
+ *
+ * - commit: re-rendering each output from scratch
+ * - node-at: looking up the node under a random point
+ * - move: moving every node, followed by a flush
+ * - damage: attaching a new buffer with a small damage region to every node,
+ *   then committing each output
+ *
+ * Heap allocations made during the timed sections are counted too, when
+ * built against glibc. */
+
+static const int output_width = 1920, output_height = 1080;
+
+struct bench_output {
+	struct wlr_output *wlr;
+	struct wlr_scene_output *scene_output;
+	bool frame;
+
+	struct wl_listener frame_listener;
+};
+
+struct bench {
+	struct wl_display *display;
+	struct wlr_backend *backend;
+	struct wlr_renderer *renderer;
+	struct wlr_allocator *allocator;
+	struct wlr_scene *scene;
+
+	struct bench_output *outputs;
+	int outputs_len;
+
+	struct wlr_scene_buffer **nodes;
+	int nodes_len;
+
+	struct wlr_buffer *buffers[2];
+	int layout_width, layout_height;
+};
+
+struct bench_buffer {
+	struct wlr_buffer base;
+	void *data;
+	size_t stride;
+};
+
+struct bench_params {
+	int nodes;
+	int node_size;
+	int overlap; // percent
+	int depth;
+	int outputs;
+	int iterations;
+	int threads;
+};
+
+static int64_t get_time_nsec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+#ifdef __GLIBC__
+/* Count allocations by wrapping the allocator entry points. glibc exports
+ * its implementation under these names, and memory they return can be freed
+ * with the regular free(). Rendering threads allocate too, hence the atomic
+ * counter. */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static atomic_uint_fast64_t allocs_count;
+
+void *malloc(size_t size) {
+	atomic_fetch_add_explicit(&allocs_count, 1, memory_order_relaxed);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+	atomic_fetch_add_explicit(&allocs_count, 1, memory_order_relaxed);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+	atomic_fetch_add_explicit(&allocs_count, 1, memory_order_relaxed);
+	return __libc_realloc(ptr, size);
+}
+
+static bool get_allocs_count(uint64_t *count) {
+	*count = atomic_load_explicit(&allocs_count, memory_order_relaxed);
+	return true;
+}
+#else
+static bool get_allocs_count(uint64_t *count) {
+	*count = 0;
+	return false;
+}
+#endif
+
+/* Time and allocations accumulated over the measured sections of a
+ * benchmark */
+struct bench_measure {
+	int64_t elapsed_ns;
+	uint64_t allocs;
+
+	int64_t start_ns;
+	uint64_t start_allocs;
+};
+
+static void measure_start(struct bench_measure *measure) {
+	get_allocs_count(&measure->start_allocs);
+	measure->start_ns = get_time_nsec();
+}
+
+static void measure_stop(struct bench_measure *measure) {
+	measure->elapsed_ns += get_time_nsec() - measure->start_ns;
+	uint64_t allocs;
+	get_allocs_count(&allocs);
+	measure->allocs += allocs - measure->start_allocs;
+}
+
+static void report(const char *name, const struct bench_measure *measure,
+		int64_t ops) {
+	uint64_t allocs;
+	if (get_allocs_count(&allocs)) {
+		printf("%-10s %12" PRId64 " ops %14.1f ns/op %10.2f allocs/op\n",
+			name, ops, (double)measure->elapsed_ns / ops,
+			(double)measure->allocs / ops);
+	} else {
+		printf("%-10s %12" PRId64 " ops %14.1f ns/op\n",
+			name, ops, (double)measure->elapsed_ns / ops);
+	}
+}
+
+static void output_handle_frame(struct wl_listener *listener, void *data) {
+	struct bench_output *output =
+		wl_container_of(listener, output, frame_listener);
+	output->frame = true;
+}
+
+static void output_wait_frame(struct bench *bench, struct bench_output *output) {
+	struct wl_event_loop *loop = wl_display_get_event_loop(bench->display);
+	while (!output->frame) {
+		wl_event_loop_dispatch(loop, -1);
+	}
+	output->frame = false;
+}
+
+/* Only wlr_scene_output_commit() is measured, not waiting for the next
+ * frame */
+static void commit_all_outputs(struct bench *bench, bool damage_whole,
+		struct bench_measure *measure) {
+	for (int i = 0; i < bench->outputs_len; i++) {
+		struct bench_output *output = &bench->outputs[i];
+		output_wait_frame(bench, output);
+
+		if (damage_whole) {
+			wlr_damage_ring_add_whole(&output->scene_output->damage_ring);
+		}
+
+		measure_start(measure);
+		if (!wlr_scene_output_commit(output->scene_output)) {
+			wlr_log(WLR_ERROR, "Failed to commit output %s", output->wlr->name);
+		}
+		measure_stop(measure);
+
+		// Nothing was committed if there was no damage, so there won't be
+		// a frame event either
+		if (!output->wlr->frame_pending) {
+			output->frame = true;
+		}
+
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		wlr_scene_output_send_frame_done(output->scene_output, &now);
+	}
+}
+
+static bool bench_init_outputs(struct bench *bench, int outputs_len) {
+	bench->outputs = calloc(outputs_len, sizeof(*bench->outputs));
+	if (bench->outputs == NULL) {
+		return false;
+	}
+	bench->outputs_len = outputs_len;
+
+	for (int i = 0; i < outputs_len; i++) {
+		struct bench_output *output = &bench->outputs[i];
+		output->wlr = wlr_headless_add_output(bench->backend,
+			output_width, output_height);
+		if (output->wlr == NULL) {
+			return false;
+		}
+
+		wlr_output_init_render(output->wlr, bench->allocator, bench->renderer);
+
+		output->frame_listener.notify = output_handle_frame;
+		wl_signal_add(&output->wlr->events.frame, &output->frame_listener);
+
+		// Headless outputs can't go faster than one frame per millisecond
+		wlr_output_enable(output->wlr, true);
+		wlr_output_set_custom_mode(output->wlr, output_width, output_height,
+			1000 * 1000);
+		if (!wlr_output_commit(output->wlr)) {
+			return false;
+		}
+		output->frame = true;
+
+		output->scene_output = wlr_scene_output_create(bench->scene, output->wlr);
+		if (output->scene_output == NULL) {
+			return false;
+		}
+		wlr_scene_output_set_position(output->scene_output, i * output_width, 0);
+	}
+
+	bench->layout_width = outputs_len * output_width;
+	bench->layout_height = output_height;
+	return true;
+}
+
+static void bench_buffer_destroy(struct wlr_buffer *wlr_buffer) {
+	struct bench_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+	free(buffer->data);
+	free(buffer);
+}
+
+static bool bench_buffer_begin_data_ptr_access(struct wlr_buffer *wlr_buffer,
+		uint32_t flags, void **data, uint32_t *format, size_t *stride) {
+	struct bench_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+	*data = buffer->data;
+	*format = DRM_FORMAT_ARGB8888;
+	*stride = buffer->stride;
+	return true;
+}
+
+static void bench_buffer_end_data_ptr_access(struct wlr_buffer *wlr_buffer) {
+	// This space is intentionally left blank
+}
+
+static const struct wlr_buffer_impl bench_buffer_impl = {
+	.destroy = bench_buffer_destroy,
+	.begin_data_ptr_access = bench_buffer_begin_data_ptr_access,
+	.end_data_ptr_access = bench_buffer_end_data_ptr_access,
+};
+
+static bool bench_init_buffers(struct bench *bench, int size) {
+	for (size_t i = 0; i < sizeof(bench->buffers) / sizeof(bench->buffers[0]); i++) {
+		struct bench_buffer *buffer = calloc(1, sizeof(*buffer));
+		if (buffer == NULL) {
+			return false;
+		}
+		wlr_buffer_init(&buffer->base, &bench_buffer_impl, size, size);
+
+		buffer->stride = (size_t)size * 4;
+		buffer->data = malloc(buffer->stride * size);
+		if (buffer->data == NULL) {
+			wlr_buffer_drop(&buffer->base);
+			return false;
+		}
+
+		// Semi-transparent, so that nodes below are blended
+		uint32_t *pixels = buffer->data;
+		for (size_t j = 0; j < (size_t)size * size; j++) {
+			pixels[j] = i == 0 ? 0x80ff0000 : 0x800000ff;
+		}
+
+		bench->buffers[i] = &buffer->base;
+	}
+	return true;
+}
+
+static bool bench_init_scene(struct bench *bench,
+		const struct bench_params *params) {
+	bench->nodes = calloc(params->nodes, sizeof(*bench->nodes));
+	if (bench->nodes == NULL) {
+		return false;
+	}
+	bench->nodes_len = params->nodes;
+
+	int step = params->node_size * (100 - params->overlap) / 100;
+	if (step < 1) {
+		step = 1;
+	}
+	int columns = (bench->layout_width - params->node_size) / step + 1;
+	if (columns < 1) {
+		columns = 1;
+	}
+
+	for (int i = 0; i < params->nodes; i++) {
+		// Emulate nested sub-surfaces with a chain of trees
+		struct wlr_scene_tree *parent = &bench->scene->tree;
+		for (int j = 0; j < params->depth; j++) {
+			parent = wlr_scene_tree_create(parent);
+			if (parent == NULL) {
+				return false;
+			}
+			wlr_scene_node_set_position(&parent->node, 1, 1);
+		}
+
+		struct wlr_scene_buffer *node =
+			wlr_scene_buffer_create(parent, bench->buffers[0]);
+		if (node == NULL) {
+			return false;
+		}
+
+		int x = (i % columns) * step;
+		int y = ((i / columns) * step) % bench->layout_height;
+		wlr_scene_node_set_position(&node->node, x, y);
+		bench->nodes[i] = node;
+	}
+
+	wlr_scene_flush(bench->scene);
+	return true;
+}
+
+static void bench_commit(struct bench *bench, int iterations) {
+	// Warm up textures
+	struct bench_measure warmup = {0};
+	commit_all_outputs(bench, true, &warmup);
+
+	struct bench_measure measure = {0};
+	for (int i = 0; i < iterations; i++) {
+		commit_all_outputs(bench, true, &measure);
+	}
+	report("commit", &measure, (int64_t)iterations * bench->outputs_len);
+}
+
+static void bench_node_at(struct bench *bench, int iterations) {
+	int64_t ops = (int64_t)iterations * 1000;
+
+	// Generate the query points upfront so that only lookups are measured
+	double *points = calloc(ops, 2 * sizeof(points[0]));
+	if (points == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return;
+	}
+	for (int64_t i = 0; i < ops; i++) {
+		points[2 * i] = rand() % bench->layout_width;
+		points[2 * i + 1] = rand() % bench->layout_height;
+	}
+
+	struct bench_measure measure = {0};
+	measure_start(&measure);
+	for (int64_t i = 0; i < ops; i++) {
+		double sx, sy;
+		wlr_scene_node_at(&bench->scene->tree.node,
+			points[2 * i], points[2 * i + 1], &sx, &sy);
+	}
+	measure_stop(&measure);
+	report("node-at", &measure, ops);
+
+	free(points);
+}
+
+static void bench_move(struct bench *bench, int iterations) {
+	struct bench_measure measure = {0};
+	measure_start(&measure);
+	for (int i = 0; i < iterations; i++) {
+		int delta = i % 2 == 0 ? 1 : -1;
+		for (int j = 0; j < bench->nodes_len; j++) {
+			struct wlr_scene_node *node = &bench->nodes[j]->node;
+			wlr_scene_node_set_position(node, node->x + delta, node->y + delta);
+		}
+		wlr_scene_flush(bench->scene);
+	}
+	measure_stop(&measure);
+	report("move", &measure, (int64_t)iterations * bench->nodes_len);
+}
+
+static void bench_damage(struct bench *bench, int iterations) {
+	pixman_region32_t damage;
+	pixman_region32_init_rect(&damage, 0, 0, 16, 16);
+
+	struct bench_measure measure = {0};
+	for (int i = 0; i < iterations; i++) {
+		measure_start(&measure);
+		struct wlr_buffer *buffer = bench->buffers[(i + 1) % 2];
+		for (int j = 0; j < bench->nodes_len; j++) {
+			wlr_scene_buffer_set_buffer_with_damage(bench->nodes[j],
+				buffer, &damage);
+		}
+		measure_stop(&measure);
+
+		commit_all_outputs(bench, false, &measure);
+	}
+
+	pixman_region32_fini(&damage);
+	report("damage", &measure, (int64_t)iterations * bench->outputs_len);
+}
+
+static const char usage[] =
+	"usage: %s [options]\n"
+	"  -n <count>       number of buffer nodes (default: 1000)\n"
+	"  -s <size>        width and height of each node (default: 128)\n"
+	"  -v <percent>     overlap between neighbouring nodes (default: 50)\n"
+	"  -d <depth>       number of trees above each node (default: 2)\n"
+	"  -o <count>       number of outputs (default: 1)\n"
+	"  -i <iterations>  iterations per benchmark (default: 100)\n"
+	"  -t <threads>     pixman rendering threads (default: 1)\n";
+
+int main(int argc, char *argv[]) {
+	wlr_log_init(WLR_ERROR, NULL);
+
+	struct bench_params params = {
+		.nodes = 1000,
+		.node_size = 128,
+		.overlap = 50,
+		.depth = 2,
+		.outputs = 1,
+		.iterations = 100,
+		.threads = 1,
+	};
+
+	int c;
+	while ((c = getopt(argc, argv, "n:s:v:d:o:i:t:h")) != -1) {
+		switch (c) {
+		case 'n':
+			params.nodes = atoi(optarg);
+			break;
+		case 's':
+			params.node_size = atoi(optarg);
+			break;
+		case 'v':
+			params.overlap = atoi(optarg);
+			break;
+		case 'd':
+			params.depth = atoi(optarg);
+			break;
+		case 'o':
+			params.outputs = atoi(optarg);
+			break;
+		case 'i':
+			params.iterations = atoi(optarg);
+			break;
+		case 't':
+			params.threads = atoi(optarg);
+			break;
+		default:
+			printf(usage, argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind < argc || params.nodes <= 0 || params.node_size <= 0 ||
+			params.overlap < 0 || params.overlap >= 100 || params.depth < 0 ||
+			params.outputs <= 0 || params.iterations <= 0 || params.threads <= 0) {
+		printf(usage, argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	srand(1);
+
+	// Read by the pixman renderer on creation
+	char threads_str[16];
+	snprintf(threads_str, sizeof(threads_str), "%d", params.threads);
+	setenv("WLR_PIXMAN_THREADS", threads_str, 1);
+
+	struct bench bench = {0};
+	bench.display = wl_display_create();
+	bench.backend = wlr_headless_backend_create(bench.display);
+	bench.renderer = wlr_pixman_renderer_create();
+	if (bench.backend == NULL || bench.renderer == NULL) {
+		return EXIT_FAILURE;
+	}
+	bench.allocator = wlr_allocator_autocreate(bench.backend, bench.renderer);
+	bench.scene = wlr_scene_create();
+	if (bench.allocator == NULL || bench.scene == NULL) {
+		return EXIT_FAILURE;
+	}
+	wlr_scene_set_batching(bench.scene, true);
+
+	if (!wlr_backend_start(bench.backend) ||
+			!bench_init_outputs(&bench, params.outputs) ||
+			!bench_init_buffers(&bench, params.node_size) ||
+			!bench_init_scene(&bench, &params)) {
+		wlr_log(WLR_ERROR, "Failed to set up the benchmark");
+		return EXIT_FAILURE;
+	}
+
+	printf("%d nodes of %dx%d, %d%% overlap, depth %d, %d output(s), "
+		"%d thread(s)\n", params.nodes, params.node_size, params.node_size,
+		params.overlap, params.depth, params.outputs, params.threads);
+
+	bench_commit(&bench, params.iterations);
+	bench_node_at(&bench, params.iterations);
+	bench_move(&bench, params.iterations);
+	bench_damage(&bench, params.iterations);
+
+	wlr_scene_node_destroy(&bench.scene->tree.node);
+	for (size_t i = 0; i < sizeof(bench.buffers) / sizeof(bench.buffers[0]); i++) {
+		wlr_buffer_drop(bench.buffers[i]);
+	}
+	free(bench.nodes);
+	for (int i = 0; i < bench.outputs_len; i++) {
+		wl_list_remove(&bench.outputs[i].frame_listener.link);
+	}
+	free(bench.outputs);
+	wl_display_destroy(bench.display);
+	wlr_allocator_destroy(bench.allocator);
+	wlr_renderer_destroy(bench.renderer);
+	return EXIT_SUCCESS;
+}
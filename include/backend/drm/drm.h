@@ -9,6 +9,7 @@
 #include <wayland-util.h>
 #include <wlr/backend/drm.h>
 #include <wlr/backend/session.h>
+#include <wlr/render/dmabuf.h>
 #include <wlr/render/drm_format_set.h>
 #include <wlr/types/wlr_output_layer.h>
 #include <xf86drmMode.h>
@@ -81,6 +82,8 @@ struct wlr_drm_backend {
 	const struct wlr_drm_interface *iface;
 	clockid_t clock;
 	bool addfb2_modifiers;
+	// Set by the DRM interface if DRM_MODE_PAGE_FLIP_ASYNC is supported
+	bool supports_tearing_page_flips;
 
 	int fd;
 	int render_fd;
@@ -116,6 +119,10 @@ struct wlr_drm_backend {
 	uint64_t cursor_width, cursor_height;
 
 	struct wlr_drm_format_set mgpu_formats;
+
+	// Incremented when cached test results may have become stale, see
+	// wlr_drm_connector.test_cache
+	uint64_t test_generation;
 };
 
 struct wlr_drm_mode {
@@ -124,11 +131,36 @@ struct wlr_drm_mode {
 };
 
 struct wlr_drm_connector_state {
+	struct wlr_drm_connector *connector;
 	const struct wlr_output_state *base;
 	bool modeset;
 	bool active;
 	drmModeModeInfo mode;
 	struct wlr_drm_fb *primary_fb;
+	int primary_in_fence_fd; // -1 if the primary FB is ready
+};
+
+#define DRM_TEST_CACHE_SIZE 4
+
+// Everything a page-flip test request depends on
+struct wlr_drm_test_key {
+	uint64_t generation; // wlr_drm_backend.test_generation
+	uint32_t crtc_id;
+	uint32_t format;
+	uint64_t modifier;
+	int32_t width, height;
+	int n_planes;
+	uint32_t offset[WLR_DMABUF_MAX_PLANES];
+	uint32_t stride[WLR_DMABUF_MAX_PLANES];
+	bool cursor_visible;
+	uint32_t cursor_fb_id;
+	int cursor_x, cursor_y;
+};
+
+struct wlr_drm_test_result {
+	bool valid;
+	bool ok;
+	struct wlr_drm_test_key key;
 };
 
 struct wlr_drm_connector {
@@ -152,6 +184,9 @@ struct wlr_drm_connector {
 	int cursor_hotspot_x, cursor_hotspot_y;
 	/* Buffer to be submitted to the kernel on the next page-flip */
 	struct wlr_drm_fb *cursor_pending_fb;
+	// The cursor changed since the last commit, which async page-flips
+	// can't apply
+	bool cursor_dirty;
 
 	struct wl_list link; // wlr_drm_backend.connectors
 
@@ -163,6 +198,16 @@ struct wlr_drm_connector {
 	 * they're sent.
 	 */
 	uint32_t pending_page_flip_crtc;
+	// Whether the last page-flip has been performed without waiting for
+	// vblank. Set by the DRM interface.
+	bool page_flip_async;
+
+	/* Results of recent page-flip tests. Steady-state direct scan-out tests
+	 * the same kind of buffer every frame, so skip the TEST_ONLY commit when
+	 * nothing it depends on has changed.
+	 */
+	struct wlr_drm_test_result test_cache[DRM_TEST_CACHE_SIZE];
+	size_t test_cache_next;
 };
 
 struct wlr_drm_backend *get_drm_backend_from_backend(
@@ -177,6 +222,9 @@ int handle_drm_event(int fd, uint32_t mask, void *data);
 void destroy_drm_connector(struct wlr_drm_connector *conn);
 bool drm_connector_commit_state(struct wlr_drm_connector *conn,
 	const struct wlr_output_state *state);
+bool drm_commit(struct wlr_drm_backend *drm,
+	const struct wlr_backend_output_state *states, size_t states_len,
+	bool test_only);
 bool drm_connector_is_cursor_visible(struct wlr_drm_connector *conn);
 bool drm_connector_supports_vrr(struct wlr_drm_connector *conn);
 size_t drm_crtc_get_gamma_lut_size(struct wlr_drm_backend *drm,
@@ -2,6 +2,7 @@
 #define BACKEND_DRM_IFACE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
@@ -19,6 +20,10 @@ struct wlr_drm_interface {
 	bool (*crtc_commit)(struct wlr_drm_connector *conn,
 		const struct wlr_drm_connector_state *state, uint32_t flags,
 		bool test_only);
+	// Commit all pending changes on multiple CRTCs at once. Optional.
+	bool (*commit)(struct wlr_drm_backend *drm,
+		const struct wlr_drm_connector_state *states, size_t states_len,
+		uint32_t flags, bool test_only);
 };
 
 extern const struct wlr_drm_interface atomic_iface;
@@ -47,8 +47,15 @@ void drm_fb_clear(struct wlr_drm_fb **fb);
 void drm_fb_move(struct wlr_drm_fb **new, struct wlr_drm_fb **old);
 struct wlr_drm_fb *drm_fb_lock(struct wlr_drm_fb *fb);
 
+/**
+ * Blit the buffer into the surface's next swapchain buffer.
+ *
+ * If sync_file_fd is not NULL, the blit may complete asynchronously: it's set
+ * to a sync_file FD signalled when the blit is done, or -1 if the blit has
+ * already completed. Otherwise the blit is complete on return.
+ */
 struct wlr_buffer *drm_surface_blit(struct wlr_drm_surface *surf,
-	struct wlr_buffer *buffer);
+	struct wlr_buffer *buffer, int *sync_file_fd);
 
 struct wlr_drm_format *drm_plane_pick_render_format(
 		struct wlr_drm_plane *plane, struct wlr_drm_renderer *renderer);
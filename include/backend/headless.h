@@ -21,10 +21,17 @@ struct wlr_headless_output {
 	struct wl_list link;
 
 	struct wl_event_source *frame_timer;
-	int frame_delay; // ms
+	int64_t refresh_nsec;
+	// Emulated vblanks happen every refresh_nsec, starting from this one
+	int64_t last_vblank_nsec;
+	int64_t next_vblank_nsec; // 0 if the frame timer isn't armed
+
+	bool present_pending;
+	uint32_t present_commit_seq;
 };
 
 struct wlr_headless_backend *headless_backend_from_backend(
 	struct wlr_backend *wlr_backend);
+void headless_output_schedule_vblank(struct wlr_headless_output *output);
 
 #endif
@@ -5,5 +5,10 @@
 
 struct wlr_allocator *allocator_autocreate_with_drm_fd(
 	struct wlr_backend *backend, struct wlr_renderer *renderer, int drm_fd);
+/**
+ * Create a DMA-BUF allocator for the DRM FD, regardless of what a backend
+ * supports. Returns NULL if none is available.
+ */
+struct wlr_allocator *allocator_create_dmabuf_with_drm_fd(int drm_fd);
 
 #endif
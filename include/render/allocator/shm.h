@@ -1,18 +1,47 @@
 #ifndef RENDER_ALLOCATOR_SHM_H
 #define RENDER_ALLOCATOR_SHM_H
 
+#include <wayland-util.h>
 #include <wlr/types/wlr_buffer.h>
 #include "render/allocator/allocator.h"
 
+/**
+ * A shared memory file which buffers are carved out of.
+ *
+ * Slabs are reference-counted by their buffers, so that buffers can outlive
+ * the allocator.
+ */
+struct wlr_shm_slab {
+	struct wlr_shm_allocator *allocator; // NULL if the allocator is destroyed
+	struct wl_list link; // wlr_shm_allocator.slabs
+
+	int fd;
+	void *data;
+	size_t size;
+	size_t used; // bytes handed out from the start of the slab
+	size_t n_buffers;
+
+	struct wl_array free_chunks; // struct wlr_shm_chunk
+};
+
+struct wlr_shm_chunk {
+	size_t offset, size;
+};
+
 struct wlr_shm_buffer {
 	struct wlr_buffer base;
 	struct wlr_shm_attributes shm;
 	void *data;
 	size_t size;
+
+	struct wlr_shm_slab *slab;
 };
 
 struct wlr_shm_allocator {
 	struct wlr_allocator base;
+
+	struct wl_list slabs; // wlr_shm_slab.link
+	size_t page_size;
 };
 
 /**
@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <sys/types.h>
+#include <wlr/render/dmabuf.h>
 
 // Copied from <linux/dma-buf.h> to avoid #ifdef soup
 #define DMA_BUF_SYNC_READ      (1 << 0)
@@ -16,6 +18,33 @@
  */
 bool dmabuf_check_sync_file_import_export(void);
 
+/**
+ * Identifies the memory behind a DMA-BUF, independently of the FDs referring
+ * to it.
+ */
+struct dmabuf_key {
+	int32_t width, height;
+	uint32_t format;
+	uint64_t modifier;
+	int n_planes;
+	struct {
+		dev_t dev;
+		ino_t ino;
+		uint32_t offset, stride;
+	} planes[WLR_DMABUF_MAX_PLANES];
+};
+
+/**
+ * Compute the key of a DMA-BUF by stat'ing its plane FDs.
+ *
+ * The inode of a DMA-BUF is only unique while the DMA-BUF is alive, so callers
+ * caching by key need to keep a reference to it (e.g. an import).
+ */
+bool dmabuf_get_key(const struct wlr_dmabuf_attributes *attribs,
+	struct dmabuf_key *key);
+
+bool dmabuf_key_equal(const struct dmabuf_key *a, const struct dmabuf_key *b);
+
 /**
  * Import a sync_file into a DMA-BUF with DMA_BUF_IOCTL_IMPORT_SYNC_FILE.
  *
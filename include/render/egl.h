@@ -16,6 +16,7 @@ struct wlr_egl {
 		bool EXT_image_dma_buf_import_modifiers;
 		bool IMG_context_priority;
 		bool EXT_create_context_robustness;
+		bool ANDROID_native_fence_sync;
 
 		// Device extensions
 		bool EXT_device_drm;
@@ -38,6 +39,9 @@ struct wlr_egl {
 		PFNEGLQUERYDISPLAYATTRIBEXTPROC eglQueryDisplayAttribEXT;
 		PFNEGLQUERYDEVICESTRINGEXTPROC eglQueryDeviceStringEXT;
 		PFNEGLQUERYDEVICESEXTPROC eglQueryDevicesEXT;
+		PFNEGLCREATESYNCKHRPROC eglCreateSyncKHR;
+		PFNEGLDESTROYSYNCKHRPROC eglDestroySyncKHR;
+		PFNEGLDUPNATIVEFENCEFDANDROIDPROC eglDupNativeFenceFDANDROID;
 	} procs;
 
 	bool has_modifiers;
@@ -90,6 +94,20 @@ bool wlr_egl_destroy_image(struct wlr_egl *egl, EGLImageKHR image);
 
 int wlr_egl_dup_drm_fd(struct wlr_egl *egl);
 
+/**
+ * Insert a native fence in the current context's command stream. Returns
+ * EGL_NO_SYNC_KHR if EGL_ANDROID_native_fence_sync isn't supported.
+ *
+ * The fence must be flushed before wlr_egl_export_sync_file() is called.
+ */
+EGLSyncKHR wlr_egl_create_native_fence(struct wlr_egl *egl);
+
+/**
+ * Export a sync_file from a native fence and destroy the fence. Returns -1 on
+ * error.
+ */
+int wlr_egl_export_sync_file(struct wlr_egl *egl, EGLSyncKHR sync);
+
 /**
  * Save the current EGL context to the structure provided in the argument.
  *
@@ -3,6 +3,7 @@
 
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
+#include <pixman.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
@@ -13,6 +14,7 @@
 #include <wlr/render/wlr_texture.h>
 #include <wlr/util/addon.h>
 #include <wlr/util/log.h>
+#include "render/dmabuf.h"
 
 struct wlr_gles2_pixel_format {
 	uint32_t drm_format;
@@ -31,6 +33,23 @@ struct wlr_gles2_tex_shader {
 	GLint tex_attrib;
 };
 
+#define GLES2_STAGING_SEGMENTS 4
+
+/**
+ * A pixel unpack buffer used as a ring to stream shm texture uploads. The ring
+ * is split in segments. A fence is put on a segment when the head leaves it,
+ * and waited on when the head enters it again after wrapping around, so that
+ * the CPU never overwrites data the GPU hasn't consumed yet.
+ */
+struct wlr_gles2_staging_ring {
+	GLuint pbo; // 0 if unavailable
+	size_t size;
+	size_t head;
+	size_t segment; // the segment being filled, never fenced
+	void *map; // persistent mapping, NULL if mapped per-upload
+	GLsync fences[GLES2_STAGING_SEGMENTS];
+};
+
 struct wlr_gles2_renderer {
 	struct wlr_renderer wlr_renderer;
 
@@ -47,6 +66,7 @@ struct wlr_gles2_renderer {
 		bool EXT_texture_type_2_10_10_10_REV;
 		bool OES_texture_half_float_linear;
 		bool EXT_texture_norm16;
+		bool EXT_buffer_storage;
 	} exts;
 
 	struct {
@@ -57,6 +77,13 @@ struct wlr_gles2_renderer {
 		PFNGLPUSHDEBUGGROUPKHRPROC glPushDebugGroupKHR;
 		PFNGLEGLIMAGETARGETRENDERBUFFERSTORAGEOESPROC glEGLImageTargetRenderbufferStorageOES;
 		PFNGLGETGRAPHICSRESETSTATUSKHRPROC glGetGraphicsResetStatusKHR;
+		// GLES 3.0 core, only loaded if available
+		PFNGLMAPBUFFERRANGEEXTPROC glMapBufferRange;
+		PFNGLUNMAPBUFFEROESPROC glUnmapBuffer;
+		PFNGLFENCESYNCAPPLEPROC glFenceSync;
+		PFNGLCLIENTWAITSYNCAPPLEPROC glClientWaitSync;
+		PFNGLDELETESYNCAPPLEPROC glDeleteSync;
+		PFNGLBUFFERSTORAGEEXTPROC glBufferStorageEXT;
 	} procs;
 
 	struct {
@@ -73,6 +100,11 @@ struct wlr_gles2_renderer {
 
 	struct wl_list buffers; // wlr_gles2_buffer.link
 	struct wl_list textures; // wlr_gles2_texture.link
+	// DMA-BUF textures whose buffer is gone, most recently used first
+	struct wl_list dmabuf_cache; // wlr_gles2_texture.cache_link
+	size_t dmabuf_cache_len, dmabuf_cache_bytes;
+
+	struct wlr_gles2_staging_ring staging;
 
 	struct wlr_gles2_buffer *current_buffer;
 	uint32_t viewport_width, viewport_height;
@@ -110,6 +142,14 @@ struct wlr_gles2_texture {
 	// If imported from a wlr_buffer
 	struct wlr_buffer *buffer;
 	struct wlr_addon buffer_addon;
+
+	// If imported from a DMA-BUF, identifies the imported memory
+	bool has_dmabuf_key;
+	struct dmabuf_key dmabuf_key;
+	size_t dmabuf_size; // estimated
+	bool cached;
+	int64_t cached_msec; // when the buffer was destroyed
+	struct wl_list cache_link; // wlr_gles2_renderer.dmabuf_cache
 };
 
 
@@ -129,6 +169,25 @@ struct wlr_gles2_texture *gles2_get_texture(
 struct wlr_texture *gles2_texture_from_buffer(struct wlr_renderer *wlr_renderer,
 	struct wlr_buffer *buffer);
 void gles2_texture_destroy(struct wlr_gles2_texture *texture);
+/**
+ * Drop cached DMA-BUF textures which are too old, or exceed the cache's count
+ * or size limits.
+ */
+void gles2_dmabuf_cache_trim(struct wlr_gles2_renderer *renderer);
+
+void gles2_staging_init(struct wlr_gles2_renderer *renderer);
+void gles2_staging_finish(struct wlr_gles2_renderer *renderer);
+/**
+ * Upload the damaged region of the pixel data to the currently bound
+ * GL_TEXTURE_2D through the staging ring. The data is copied, so it may be
+ * released as soon as this returns.
+ *
+ * Returns false if nothing was uploaded, in which case the caller needs to
+ * upload the data directly.
+ */
+bool gles2_staging_upload(struct wlr_gles2_renderer *renderer,
+	const struct wlr_gles2_pixel_format *fmt, uint32_t bytes_per_pixel,
+	const void *data, size_t stride, const pixman_region32_t *damage);
 
 void push_gles2_debug_(struct wlr_gles2_renderer *renderer,
 	const char *file, const char *func);
@@ -1,6 +1,7 @@
 #ifndef RENDER_PIXMAN_H
 #define RENDER_PIXMAN_H
 
+#include <pthread.h>
 #include <wlr/render/pixman.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/render/drm_format_set.h>
@@ -12,6 +13,7 @@ struct wlr_pixman_pixel_format {
 };
 
 struct wlr_pixman_buffer;
+struct wlr_pixman_bands;
 
 struct wlr_pixman_renderer {
 	struct wlr_renderer wlr_renderer;
@@ -22,7 +24,13 @@ struct wlr_pixman_renderer {
 	struct wlr_pixman_buffer *current_buffer;
 	int32_t width, height;
 
+	struct wlr_box scissor_box;
+	bool has_scissor;
+
 	struct wlr_drm_format_set drm_formats;
+
+	// NULL if rendering on a single thread
+	struct wlr_pixman_bands *bands;
 };
 
 struct wlr_pixman_buffer {
@@ -52,4 +60,86 @@ pixman_format_code_t get_pixman_format_from_drm(uint32_t fmt);
 uint32_t get_drm_format_from_pixman(pixman_format_code_t fmt);
 const uint32_t *get_pixman_drm_formats(size_t *len);
 
+/**
+ * A source for a deferred composite operation. Worker threads get their own
+ * copy of the image, since pixman images aren't thread-safe.
+ */
+struct wlr_pixman_band_src {
+	pixman_image_t *image; // bits image, NULL for a solid fill
+	struct pixman_color color; // if image is NULL
+	const struct pixman_transform *transform; // may be NULL
+	pixman_filter_t filter;
+};
+
+struct wlr_pixman_band_op {
+	pixman_op_t op;
+	pixman_image_t *src, *mask;
+	int src_dx, src_dy;
+	pixman_region32_t region;
+};
+
+struct wlr_pixman_band {
+	struct wlr_pixman_bands *bands;
+	pthread_t thread; // unused for the first band, rendered by the caller
+	int y1, y2;
+	pixman_image_t *dst;
+	struct wl_array ops; // struct wlr_pixman_band_op
+};
+
+/**
+ * Splits the render buffer in horizontal bands, each composited by its own
+ * thread. Operations are recorded, then executed in parallel when flushed.
+ */
+struct wlr_pixman_bands {
+	struct wlr_pixman_band *bands;
+	size_t bands_len;
+	bool recording;
+	struct wl_array held_buffers; // struct wlr_buffer *
+
+	pthread_mutex_t lock;
+	pthread_cond_t start_cond, done_cond;
+	uint64_t generation; // bumped to start rendering
+	size_t pending; // bands still rendering
+	bool quit;
+};
+
+/**
+ * Create worker threads if WLR_PIXMAN_THREADS is greater than 1. Returns NULL
+ * otherwise, or on failure.
+ */
+struct wlr_pixman_bands *pixman_bands_create(void);
+void pixman_bands_destroy(struct wlr_pixman_bands *bands);
+/**
+ * Start recording operations targeting the image. Returns false on failure,
+ * in which case the caller needs to render without the bands.
+ */
+bool pixman_bands_begin(struct wlr_pixman_bands *bands, pixman_image_t *dst);
+/**
+ * Record an operation, clipped to the region.
+ */
+void pixman_bands_composite(struct wlr_pixman_bands *bands, pixman_op_t op,
+	const struct wlr_pixman_band_src *src, float alpha, int src_dx, int src_dy,
+	const pixman_region32_t *region);
+/**
+ * Keep data pointer access to the buffer until the next flush. The caller
+ * must have begun the access.
+ */
+bool pixman_bands_hold_buffer(struct wlr_pixman_bands *bands,
+	struct wlr_buffer *buffer);
+bool pixman_bands_holds_buffer(struct wlr_pixman_bands *bands,
+	struct wlr_buffer *buffer);
+/**
+ * Execute the recorded operations, and wait for all bands to be done.
+ */
+void pixman_bands_flush(struct wlr_pixman_bands *bands);
+void pixman_bands_end(struct wlr_pixman_bands *bands);
+
+/**
+ * Create a texture holding a copy of the buffer's contents, instead of
+ * referencing the buffer's memory like wlr_texture_from_buffer() does. The
+ * texture can then be updated with wlr_texture_update_from_buffer().
+ */
+struct wlr_texture *pixman_texture_copy_from_buffer(
+	struct wlr_renderer *wlr_renderer, struct wlr_buffer *buffer);
+
 #endif
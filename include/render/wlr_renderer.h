@@ -15,6 +15,12 @@ struct wlr_renderer *renderer_autocreate_with_drm_fd(int drm_fd);
  * calling renderer_bind_buffer with a NULL buffer.
  */
 bool renderer_bind_buffer(struct wlr_renderer *r, struct wlr_buffer *buffer);
+/**
+ * End a render pass without waiting for the GPU to finish. Returns a sync_file
+ * FD signalled when rendering is complete, or -1 if the renderer doesn't
+ * support it, in which case this behaves like wlr_renderer_end().
+ */
+int renderer_end_with_sync_file(struct wlr_renderer *r);
 /**
  * Get the supported render formats. Buffers allocated with a format from this
  * list may be attached via wlr_renderer_begin_with_buffer.
@@ -15,4 +15,32 @@ void output_clear_back_buffer(struct wlr_output *output);
 bool output_ensure_buffer(struct wlr_output *output,
 	const struct wlr_output_state *state, bool *new_back_buffer);
 
+/**
+ * Build the state handed to the backend: unchanged fields are filtered out and
+ * a buffer is rendered if the backend needs one. If new_back_buffer is set,
+ * the caller must unlock pending->buffer once done.
+ */
+bool output_prepare_commit(struct wlr_output *output,
+	const struct wlr_output_state *state, struct wlr_output_state *pending,
+	bool *new_back_buffer);
+void output_precommit(struct wlr_output *output,
+	const struct wlr_output_state *pending, struct timespec *now);
+/**
+ * Update the output after the backend has successfully committed a state.
+ */
+void output_apply_commit(struct wlr_output *output,
+	const struct wlr_output_state *pending, struct timespec *now);
+
+void output_deadline_finish(struct wlr_output *output);
+/**
+ * Returns true if the frame event has been deferred by the deadline
+ * scheduler, in which case the caller must not send it.
+ */
+bool output_deadline_defer_frame(struct wlr_output *output);
+void output_deadline_handle_frame(struct wlr_output *output);
+void output_deadline_handle_commit(struct wlr_output *output,
+	const struct wlr_output_state *state);
+void output_deadline_handle_present(struct wlr_output *output,
+	const struct wlr_output_event_present *event);
+
 #endif
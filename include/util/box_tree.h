@@ -0,0 +1,57 @@
+#ifndef UTIL_BOX_TREE_H
+#define UTIL_BOX_TREE_H
+
+#include <stdbool.h>
+#include <wayland-util.h>
+#include <wlr/util/box.h>
+
+/**
+ * A bounding volume hierarchy over boxes, stored as a dynamic AABB tree.
+ *
+ * Leaves are inserted by picking the sibling which minimizes the perimeter
+ * growth of the tree, and the tree is rebalanced with AVL-style rotations on
+ * every insertion and removal. Queries cost O(log n + k) for k results.
+ *
+ * Leaves are identified by an integer handle which stays stable until the
+ * leaf is removed.
+ */
+struct box_tree {
+	struct wl_array nodes; // struct box_tree_node
+	int root;
+	int free_list;
+};
+
+/**
+ * Called for each leaf intersecting the queried box. Returning true stops the
+ * query.
+ */
+typedef bool (*box_tree_iterator_func_t)(void *data,
+	const struct wlr_box *box, void *user_data);
+
+void box_tree_init(struct box_tree *tree);
+
+void box_tree_finish(struct box_tree *tree);
+
+/**
+ * Insert a leaf. The box must not be empty.
+ *
+ * Returns the leaf handle, or -1 on allocation failure.
+ */
+int box_tree_insert(struct box_tree *tree, const struct wlr_box *box,
+	void *data);
+
+void box_tree_remove(struct box_tree *tree, int leaf);
+
+/**
+ * Move an existing leaf to a new, non-empty box. The handle is preserved.
+ */
+void box_tree_move(struct box_tree *tree, int leaf, const struct wlr_box *box);
+
+/**
+ * Call the iterator for every leaf intersecting the box, in no particular
+ * order. Returns true if the iterator stopped the query.
+ */
+bool box_tree_query(struct box_tree *tree, const struct wlr_box *box,
+	box_tree_iterator_func_t iterator, void *user_data);
+
+#endif
@@ -8,11 +8,21 @@
  */
 int64_t get_current_time_msec(void);
 
+/**
+ * Get the current time, in nanoseconds.
+ */
+int64_t get_current_time_nsec(void);
+
 /**
  * Convert a timespec to milliseconds.
  */
 int64_t timespec_to_msec(const struct timespec *a);
 
+/**
+ * Convert a timespec to nanoseconds.
+ */
+int64_t timespec_to_nsec(const struct timespec *a);
+
 /**
  * Convert nanoseconds to a timespec.
  */
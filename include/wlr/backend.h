@@ -10,6 +10,7 @@
 #define WLR_BACKEND_H
 
 #include <wayland-server-core.h>
+#include <wlr/types/wlr_output.h>
 
 struct wlr_session;
 struct wlr_backend_impl;
@@ -20,6 +21,12 @@ struct wlr_backend_impl;
 struct wlr_backend {
 	const struct wlr_backend_impl *impl;
 
+	struct {
+		// Whether wlr_backend_commit() can apply the states of multiple
+		// outputs of this backend in a single, all-or-nothing operation
+		bool atomic_commit;
+	} features;
+
 	struct {
 		/** Raised when destroyed */
 		struct wl_signal destroy;
@@ -30,6 +37,14 @@ struct wlr_backend {
 	} events;
 };
 
+/**
+ * A new state for an output, see wlr_backend_commit().
+ */
+struct wlr_backend_output_state {
+	struct wlr_output *output;
+	struct wlr_output_state base;
+};
+
 /**
  * Automatically initializes the most suitable backend given the environment.
  * Will always return a multi-backend. The backend is created but not started.
@@ -68,5 +83,26 @@ int wlr_backend_get_drm_fd(struct wlr_backend *backend);
  * a multi-gpu scenario. This function always returns the render node drm fd.
  */
 int wlr_backend_get_drm_render_fd(struct wlr_backend *backend);
+/**
+ * Test whether a batch of output states can be applied.
+ *
+ * See wlr_backend_commit().
+ */
+bool wlr_backend_test(struct wlr_backend *backend,
+	const struct wlr_backend_output_state *states, size_t states_len);
+/**
+ * Apply a batch of output states.
+ *
+ * When all outputs belong to a backend supporting atomic commits (see
+ * wlr_backend.features.atomic_commit), the batch is tested and committed in a
+ * single operation: either all states are applied, or none. This avoids
+ * multiple modesets when reconfiguring several outputs at once.
+ *
+ * Otherwise, the states are tested first, then committed one after the other
+ * with wlr_output_commit_state(). If a commit fails, the states before it
+ * remain applied.
+ */
+bool wlr_backend_commit(struct wlr_backend *backend,
+	const struct wlr_backend_output_state *states, size_t states_len);
 
 #endif
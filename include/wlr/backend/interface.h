@@ -20,6 +20,12 @@ struct wlr_backend_impl {
 	int (*get_drm_fd)(struct wlr_backend *backend);
 	int (*get_drm_render_fd)(struct wlr_backend *backend);
 	uint32_t (*get_buffer_caps)(struct wlr_backend *backend);
+	// Only used when wlr_backend.features.atomic_commit is set. All outputs
+	// belong to the backend.
+	bool (*test)(struct wlr_backend *backend,
+		const struct wlr_backend_output_state *states, size_t states_len);
+	bool (*commit)(struct wlr_backend *backend,
+		const struct wlr_backend_output_state *states, size_t states_len);
 };
 
 /**
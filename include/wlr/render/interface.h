@@ -25,6 +25,8 @@ struct wlr_renderer_impl {
 	bool (*begin)(struct wlr_renderer *renderer, uint32_t width,
 		uint32_t height);
 	void (*end)(struct wlr_renderer *renderer);
+	// Like end, but returns a sync_file instead of waiting for the GPU, or -1
+	int (*end_with_sync_file)(struct wlr_renderer *renderer);
 	void (*clear)(struct wlr_renderer *renderer, const float color[static 4]);
 	void (*scissor)(struct wlr_renderer *renderer, struct wlr_box *box);
 	bool (*render_subtexture_with_matrix)(struct wlr_renderer *renderer,
@@ -32,6 +34,10 @@ struct wlr_renderer_impl {
 		const float matrix[static 9], float alpha);
 	void (*render_quad_with_matrix)(struct wlr_renderer *renderer,
 		const float color[static 4], const float matrix[static 9]);
+	// Optional, the operations are drawn one clip rectangle at a time
+	// otherwise
+	bool (*render_ops)(struct wlr_renderer *renderer,
+		const struct wlr_render_op *ops, size_t ops_len);
 	const uint32_t *(*get_shm_texture_formats)(
 		struct wlr_renderer *renderer, size_t *len);
 	const struct wlr_drm_format_set *(*get_dmabuf_texture_formats)(
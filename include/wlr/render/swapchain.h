@@ -2,6 +2,7 @@
 #define WLR_RENDER_SWAPCHAIN_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <wayland-server-core.h>
 #include <wlr/render/drm_format_set.h>
 
@@ -11,10 +12,29 @@ struct wlr_swapchain_slot {
 	struct wlr_buffer *buffer;
 	bool acquired; // waiting for release
 	int age;
+	int64_t last_used_msec; // CLOCK_MONOTONIC
 
 	struct wl_listener release;
 };
 
+/**
+ * Swapchain statistics, see wlr_swapchain_get_stats().
+ *
+ * Compositors can use max_acquired to decide whether an output needs double
+ * or triple buffering.
+ */
+struct wlr_swapchain_stats {
+	size_t allocated; // buffers currently allocated
+	size_t acquired; // buffers currently acquired
+	size_t max_acquired; // maximum number of buffers acquired at once
+	uint64_t allocations; // buffers allocated over the swapchain's lifetime
+	uint64_t reclaimed; // buffers freed by wlr_swapchain_reclaim_idle()
+	uint64_t acquisitions;
+	// Acquisitions by buffer age, 0 meaning undefined contents. The last
+	// entry also counts older buffers.
+	uint64_t acquisitions_by_age[WLR_SWAPCHAIN_CAP + 1];
+};
+
 struct wlr_swapchain {
 	struct wlr_allocator *allocator; // NULL if destroyed
 
@@ -24,6 +44,14 @@ struct wlr_swapchain {
 	struct wlr_swapchain_slot slots[WLR_SWAPCHAIN_CAP];
 
 	struct wl_listener allocator_destroy;
+
+	// private state
+
+	struct wlr_swapchain_stats stats;
+
+	size_t preallocate_count;
+	struct wl_event_loop *preallocate_loop;
+	struct wl_event_source *preallocate_idle;
 };
 
 struct wlr_swapchain *wlr_swapchain_create(
@@ -38,6 +66,34 @@ void wlr_swapchain_destroy(struct wlr_swapchain *swapchain);
  */
 struct wlr_buffer *wlr_swapchain_acquire(struct wlr_swapchain *swapchain,
 	int *age);
+/**
+ * Allocate buffers until the swapchain holds at least count of them, so that
+ * the first frames don't pay for allocations. The count is clamped to
+ * WLR_SWAPCHAIN_CAP.
+ *
+ * Returns false if an allocation failed.
+ */
+bool wlr_swapchain_preallocate(struct wlr_swapchain *swapchain, size_t count);
+/**
+ * Same as wlr_swapchain_preallocate(), but buffers are allocated one at a
+ * time from idle callbacks on the event loop.
+ */
+void wlr_swapchain_preallocate_idle(struct wlr_swapchain *swapchain,
+	struct wl_event_loop *loop, size_t count);
+/**
+ * Free the buffers which are not acquired and haven't been used for at least
+ * idle_msec milliseconds, e.g. to reclaim memory when an output stops being
+ * updated.
+ *
+ * Returns the number of buffers freed.
+ */
+size_t wlr_swapchain_reclaim_idle(struct wlr_swapchain *swapchain,
+	int64_t idle_msec);
+/**
+ * Get allocation and buffer age statistics.
+ */
+void wlr_swapchain_get_stats(const struct wlr_swapchain *swapchain,
+	struct wlr_swapchain_stats *stats);
 /**
  * Mark the buffer as submitted for presentation. This needs to be called by
  * swap chain users on frame boundaries.
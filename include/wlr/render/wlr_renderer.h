@@ -12,13 +12,27 @@
 #include <stdint.h>
 #include <wayland-server-core.h>
 #include <wlr/render/wlr_texture.h>
+#include <wlr/util/box.h>
 
+struct wlr_allocator;
 struct wlr_backend;
 struct wlr_renderer_impl;
 struct wlr_drm_format_set;
 struct wlr_buffer;
-struct wlr_box;
-struct wlr_fbox;
+/**
+ * A drawing operation, see wlr_renderer_render_ops().
+ */
+struct wlr_render_op {
+	// Texture to draw, or NULL to draw a solid quad with color
+	struct wlr_texture *texture;
+	struct wlr_fbox src_box; // texture crop, ignored for solid quads
+	float color[4]; // ignored for textures
+	float matrix[9];
+	float alpha; // ignored for solid quads
+	// Only pixels inside this region, in render buffer coordinates, are
+	// drawn
+	const pixman_region32_t *clip;
+};
 
 /**
  * A renderer for basic 2D operations.
@@ -45,6 +59,12 @@ struct wlr_renderer {
 	struct wl_list multi_link;
 	/* The GPU list we are a part of, may be null if not created from multi backend */
 	struct wlr_multi_gpu *multi_gpu;
+	/*
+	 * Lazily created allocator for linear buffers shared with the other
+	 * GPUs, see wlr_texture_set
+	 */
+	struct wlr_allocator *mgpu_allocator;
+	bool mgpu_allocator_failed;
 };
 
 /**
@@ -112,6 +132,16 @@ void wlr_render_rect(struct wlr_renderer *r, const struct wlr_box *box,
  */
 void wlr_render_quad_with_matrix(struct wlr_renderer *r,
 	const float color[static 4], const float matrix[static 9]);
+/**
+ * Draws a list of operations, in order. This is equivalent to setting the
+ * scissor box to each rectangle of the clip region of an operation and calling
+ * wlr_render_subtexture_with_matrix() or wlr_render_quad_with_matrix(), but
+ * allows the renderer to submit the operations in fewer batches.
+ *
+ * The scissor box is disabled afterwards.
+ */
+bool wlr_renderer_render_ops(struct wlr_renderer *r,
+	const struct wlr_render_op *ops, size_t ops_len);
 /**
  * Get the shared-memory formats supporting import usage. Buffers allocated
  * with a format from this list may be imported via wlr_texture_from_pixels().
@@ -68,6 +68,16 @@ struct wlr_texture_renderer_pair {
 	struct wlr_renderer *renderer;
 	struct wlr_texture *texture;
 
+	/* Whether the texture was uploaded from the set's linear pixel data */
+	bool linear;
+	/* Whether the texture was imported from the set's linear DMA-BUF */
+	bool shared;
+	/*
+	 * For linear textures, the damage accumulated since the texture was
+	 * last synced with the pixel data.
+	 */
+	pixman_region32_t damage;
+
 	struct wl_listener renderer_destroy;
 };
 
@@ -90,12 +100,25 @@ struct wlr_texture_set {
 	int32_t native_pair;
 	struct wlr_multi_gpu *multi_gpu;
 	/*
-	 * This will cache the result of creating a linear-layout version of
-	 * this texture on the native device. This can then be imported into
-	 * the other GPUs.
+	 * A linear DMA-BUF allocated on the native device, which the texture is
+	 * blitted into. Other GPUs import it directly, without a copy through
+	 * the CPU.
+	 */
+	struct wlr_buffer *linear_buffer;
+	bool linear_buffer_failed;
+	/* Damage accumulated on the buffer since linear_buffer was last blitted */
+	pixman_region32_t linear_buffer_damage;
+	/*
+	 * If the linear DMA-BUF can't be used, this will cache the result of
+	 * reading back a linear-layout version of this texture on the native
+	 * device. This can then be uploaded into the other GPUs. It is kept for
+	 * the lifetime of the set, and only the damaged parts are read back
+	 * again.
 	 */
 	uint32_t format;
 	void *pixel_data;
+	/* Damage accumulated on the buffer since pixel_data was last read back */
+	pixman_region32_t readback_damage;
 
 	uint32_t width;
 	uint32_t height;
@@ -155,9 +178,23 @@ struct wlr_texture *wlr_texture_set_get_native_texture(struct wlr_texture_set *s
 /**
   * Update all textures in a set with the contents of the next buffer. This will call
   * wlr_texture_update_from_buffer for each texture in the set.
+  *
+  * If the next buffer is the DMA-BUF the set was created from, imported textures
+  * already alias its memory. Only the damage is recorded then, and copies made for
+  * other GPUs are synced lazily by wlr_texture_set_get_tex_for_renderer.
   */
 bool wlr_texture_set_update_from_buffer(struct wlr_texture_set *set,
 		struct wlr_buffer *next, const pixman_region32_t *damage);
 
+/**
+ * Drop the set's reference to the buffer it was created from, if every texture
+ * in the set holds its own copy of the contents. Textures which reference the
+ * buffer's memory (pixman) are replaced with a copy first.
+ *
+ * Returns false if the buffer is still needed: DMA-BUFs, and sets with
+ * textures yet to be created or synced for other GPUs.
+ */
+bool wlr_texture_set_release_buffer(struct wlr_texture_set *set);
+
 void wlr_texture_set_destroy(struct wlr_texture_set *set);
 #endif
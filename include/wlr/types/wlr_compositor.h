@@ -155,6 +155,8 @@ struct wlr_surface {
 
 	struct wl_listener renderer_destroy;
 
+	bool early_buffer_release;
+
 	struct {
 		int32_t scale;
 		enum wl_output_transform transform;
@@ -171,6 +173,17 @@ struct wlr_compositor {
 	struct wl_global *global;
 	struct wlr_renderer *renderer; // may be NULL
 
+	/**
+	 * Release client buffers as soon as their contents have been copied into
+	 * a texture, instead of holding them until the next commit. This lets shm
+	 * clients redraw without waiting for an extra buffer. DMA-BUFs are
+	 * always held. With the pixman renderer this costs a copy of the
+	 * buffer.
+	 *
+	 * Only applies to surfaces created after this has been set.
+	 */
+	bool early_buffer_release;
+
 	struct wl_listener display_destroy;
 
 	struct {
@@ -83,6 +83,11 @@ struct wlr_output_state {
 	// Set to true to allow temporary visual artifacts (e.g. black screen) while
 	// the update is being applied
 	bool allow_artifacts;
+	// Set to true to present the buffer right away instead of waiting for the
+	// next vblank, at the cost of tearing. Only honored for page-flips (a new
+	// buffer without a modeset) on backends which support it, otherwise the
+	// buffer is presented on vblank as usual.
+	bool tearing_page_flip;
 	pixman_region32_t damage; // output-buffer-local coordinates
 	bool enabled;
 	float scale;
@@ -113,6 +118,33 @@ struct wlr_output_state {
 
 struct wlr_output_impl;
 
+#define WLR_OUTPUT_DEADLINE_HISTORY 8
+
+/**
+ * State of the deadline-based frame scheduler, see
+ * wlr_output_set_deadline_scheduling().
+ */
+struct wlr_output_deadline {
+	bool enabled;
+
+	// private state
+
+	struct wl_event_source *timer;
+	bool deferred; // a frame event is waiting for the timer
+
+	int64_t last_vblank_nsec; // 0 if unknown
+	int64_t refresh_nsec;
+
+	int64_t frame_nsec; // when the last frame event was sent, 0 if consumed
+	int64_t target_nsec; // vblank the last frame event was sent for
+	bool missed;
+
+	// Durations from the frame event to the end of the commit
+	int64_t durations_nsec[WLR_OUTPUT_DEADLINE_HISTORY];
+	size_t durations_len, durations_index;
+	int64_t margin_nsec;
+};
+
 /**
  * A compositor output region. This typically corresponds to a monitor that
  * displays part of the compositor space.
@@ -188,6 +220,8 @@ struct wlr_output {
 	struct wl_event_source *idle_frame;
 	struct wl_event_source *idle_done;
 
+	struct wlr_output_deadline deadline;
+
 	int attach_render_locks; // number of locks forcing rendering
 
 	struct wl_list cursors; // wlr_output_cursor::link
@@ -468,6 +502,22 @@ bool wlr_output_test_state(struct wlr_output *output,
 	const struct wlr_output_state *state);
 bool wlr_output_commit_state(struct wlr_output *output,
 	const struct wlr_output_state *state);
+/**
+ * Enable or disable deadline-based frame scheduling.
+ *
+ * By default, the `frame` event is emitted as soon as the previous buffer has
+ * been presented, leaving almost a full refresh period between rendering and
+ * scan-out. With deadline scheduling, the `frame` event is delayed until the
+ * next vblank minus the time recent frames took to render and commit, minus a
+ * safety margin. This reduces latency for compositors which render in
+ * response to the `frame` event.
+ *
+ * While the event is delayed the frame is still pending, so buffers can't be
+ * committed. When a deadline is missed, the margin grows and the next `frame`
+ * event is sent right away.
+ */
+void wlr_output_set_deadline_scheduling(struct wlr_output *output,
+	bool enabled);
 /**
  * Manually schedules a `frame` event. If a `frame` event is already pending,
  * it is a no-op.
@@ -40,6 +40,9 @@ struct wlr_scene_buffer;
 struct wlr_presentation;
 struct wlr_linux_dmabuf_v1;
 
+struct box_tree;
+struct scene_timing_histogram;
+
 typedef bool (*wlr_scene_buffer_point_accepts_input_func_t)(
 	struct wlr_scene_buffer *buffer, int sx, int sy);
 
@@ -73,6 +76,9 @@ struct wlr_scene_node {
 	// private state
 
 	pixman_region32_t visible;
+	int index_leaf; // -1 if not in wlr_scene.node_index
+	uint64_t z_order; // sparse painter's order key, only set for leaves
+	struct wl_list update_link; // wlr_scene.update_nodes
 };
 
 enum wlr_scene_debug_damage_option {
@@ -106,6 +112,24 @@ struct wlr_scene {
 	enum wlr_scene_debug_damage_option debug_damage_option;
 	bool direct_scanout;
 	bool calculate_visibility;
+	bool output_layers;
+	bool timing_log;
+
+	// Leaf nodes which are enabled and have a non-empty size, keyed by their
+	// bounds in layout coordinates
+	struct box_tree *node_index;
+	// Scratch space for sorting index query results
+	struct wl_array node_index_hits;
+	bool node_index_querying;
+
+	// Nodes changed since the last wlr_scene_flush() when batching, along
+	// with the region their visibility needs to be recomputed in and the
+	// region to damage
+	bool batching;
+	struct wl_list update_nodes; // wlr_scene_node.update_link
+	pixman_region32_t pending_update;
+	pixman_region32_t pending_damage;
+	uint64_t batch_frame_outputs; // bitmask of wlr_scene_output.index
 };
 
 /** A scene-graph node displaying a single surface. */
@@ -173,6 +197,37 @@ struct wlr_scene_buffer {
 	enum wl_output_transform transform;
 	pixman_region32_t opaque_region;
 	struct wlr_linux_dmabuf_feedback_v1_init_options prev_feedback_options;
+
+	// Set if the buffer is a single-pixel buffer, which is drawn like a
+	// struct wlr_scene_rect
+	bool single_pixel;
+	float single_pixel_color[4];
+
+	bool allow_tearing;
+};
+
+/**
+ * Time spent in each stage of a frame submitted by wlr_scene_output_commit(),
+ * in nanoseconds. Stages which didn't run for the frame are zero.
+ */
+struct wlr_scene_output_frame_timing {
+	struct wlr_scene_output *output;
+	uint32_t commit_seq; // see wlr_output.commit_seq
+
+	bool direct_scanout;
+	int64_t render_list_ns; // flushing the scene, building the render list
+	int64_t cull_ns; // culling and clearing the background
+	int64_t render_ns; // rendering scene nodes
+	int64_t cursors_ns; // rendering software cursors
+	int64_t renderer_end_ns; // wlr_renderer_end()
+	int64_t commit_ns; // wlr_output_commit()
+
+	// The output commit failed, the frame was discarded
+	bool failed;
+	bool presented;
+	// From the start of wlr_scene_output_commit() until the frame was
+	// presented, zero if unknown
+	int64_t present_ns;
 };
 
 /** A viewport for an output in the scene-graph */
@@ -188,6 +243,9 @@ struct wlr_scene_output {
 
 	struct {
 		struct wl_signal destroy;
+		// emitted once a frame has been presented or discarded, including
+		// when the output commit fails
+		struct wl_signal frame_timing; // struct wlr_scene_output_frame_timing
 	} events;
 
 	// private state
@@ -196,12 +254,24 @@ struct wlr_scene_output {
 	bool prev_scanout;
 
 	struct wl_listener output_commit;
+	struct wl_listener output_present;
 	struct wl_listener output_damage;
 	struct wl_listener output_needs_frame;
 
 	struct wl_list damage_highlight_regions;
 
 	struct wl_array render_list;
+	// Set when node visibility changed on this output since the render
+	// list was last built
+	bool render_list_dirty;
+
+	struct wl_list layers; // scene_output_layer.link
+	struct wl_array layers_state; // struct wlr_output_layer_state
+
+	struct wlr_scene_output_frame_timing pending_timing;
+	int64_t pending_timing_start_ns;
+	bool timing_pending, timing_committing, timing_presented;
+	struct scene_timing_histogram *timing_histogram; // may be NULL
 };
 
 /** A layer shell scene helper */
@@ -299,6 +369,26 @@ void wlr_scene_set_presentation(struct wlr_scene *scene,
 void wlr_scene_set_linux_dmabuf_v1(struct wlr_scene *scene,
 	struct wlr_linux_dmabuf_v1 *linux_dmabuf_v1);
 
+/**
+ * Enable or disable batching of scene-graph updates. Disabled by default.
+ *
+ * By default, node visibility and output enter/leave events are updated
+ * right away on every change. When batching, they are only updated by
+ * wlr_scene_flush(), so that changing many nodes at once only walks the
+ * scene-graph once. Disabling batching flushes pending changes.
+ */
+void wlr_scene_set_batching(struct wlr_scene *scene, bool batching);
+
+/**
+ * Recompute node visibility and send output enter/leave events for all nodes
+ * changed since the last flush. Does nothing unless batching is enabled.
+ *
+ * This is done automatically by wlr_scene_output_commit() and
+ * wlr_scene_output_send_frame_done(). Compositors only need to call this if
+ * they rely on these events being sent right away.
+ */
+void wlr_scene_flush(struct wlr_scene *scene);
+
 
 /**
  * Add a node displaying nothing but its children.
@@ -399,6 +489,15 @@ void wlr_scene_buffer_set_dest_size(struct wlr_scene_buffer *scene_buffer,
 void wlr_scene_buffer_set_transform(struct wlr_scene_buffer *scene_buffer,
 	enum wl_output_transform transform);
 
+/**
+ * Allow the buffer to be presented with tearing page-flips when it is
+ * scanned out directly. This reduces latency for fullscreen clients such as
+ * games, at the cost of visible tearing. Outputs which don't support
+ * tearing page-flips fall back to regular ones.
+ */
+void wlr_scene_buffer_set_allow_tearing(struct wlr_scene_buffer *scene_buffer,
+	bool allow_tearing);
+
 /**
  * Calls the buffer's frame_done signal.
  */
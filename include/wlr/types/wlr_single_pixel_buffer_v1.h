@@ -10,10 +10,32 @@
 #define WLR_TYPES_WLR_SINGLE_PIXEL_BUFFER_V1_H
 
 #include <wayland-server-core.h>
+#include <wlr/types/wlr_buffer.h>
 
 struct wlr_single_pixel_buffer_manager_v1;
 
+/**
+ * A 1x1 buffer holding a single color.
+ */
+struct wlr_single_pixel_buffer_v1 {
+	struct wlr_buffer base;
+	// Premultiplied color components, 0xFFFFFFFF being the maximum
+	uint32_t r, g, b, a;
+
+	// private state
+
+	struct wl_resource *resource;
+	uint8_t argb8888[4]; // packed little-endian DRM_FORMAT_ARGB8888
+};
+
 struct wlr_single_pixel_buffer_manager_v1 *wlr_single_pixel_buffer_manager_v1_create(
 	struct wl_display *display);
 
+/**
+ * Get the single-pixel buffer backing a struct wlr_buffer, or NULL if the
+ * buffer isn't one.
+ */
+struct wlr_single_pixel_buffer_v1 *wlr_single_pixel_buffer_v1_try_from_buffer(
+	struct wlr_buffer *buffer);
+
 #endif
@@ -144,6 +144,22 @@ struct wlr_allocator *allocator_autocreate_with_drm_fd(
 	return NULL;
 }
 
+struct wlr_allocator *allocator_create_dmabuf_with_drm_fd(int drm_fd) {
+#if WLR_HAS_GBM_ALLOCATOR
+	int gbm_fd = reopen_drm_node(drm_fd, true);
+	if (gbm_fd < 0) {
+		return NULL;
+	}
+	struct wlr_allocator *alloc = wlr_gbm_allocator_create(gbm_fd);
+	if (alloc == NULL) {
+		close(gbm_fd);
+	}
+	return alloc;
+#else
+	return NULL;
+#endif
+}
+
 struct wlr_allocator *wlr_allocator_autocreate(struct wlr_backend *backend,
 		struct wlr_renderer *renderer) {
 	// Note, drm_fd may be negative if unavailable
@@ -12,7 +12,11 @@
 #include "render/allocator/shm.h"
 #include "util/shm.h"
 
+// Slabs are sparse files, pages are only backed once written to
+#define SHM_SLAB_SIZE (32 * 1024 * 1024)
+
 static const struct wlr_buffer_impl buffer_impl;
+static const struct wlr_allocator_interface allocator_impl;
 
 static struct wlr_shm_buffer *shm_buffer_from_buffer(
 		struct wlr_buffer *wlr_buffer) {
@@ -20,10 +24,138 @@ static struct wlr_shm_buffer *shm_buffer_from_buffer(
 	return (struct wlr_shm_buffer *)wlr_buffer;
 }
 
+static void slab_destroy(struct wlr_shm_slab *slab) {
+	wl_list_remove(&slab->link);
+	wl_array_release(&slab->free_chunks);
+	munmap(slab->data, slab->size);
+	close(slab->fd);
+	free(slab);
+}
+
+static struct wlr_shm_slab *slab_create(struct wlr_shm_allocator *allocator,
+		size_t size) {
+	struct wlr_shm_slab *slab = calloc(1, sizeof(*slab));
+	if (slab == NULL) {
+		return NULL;
+	}
+
+	slab->fd = allocate_shm_file(size);
+	if (slab->fd < 0) {
+		free(slab);
+		return NULL;
+	}
+
+	slab->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		slab->fd, 0);
+	if (slab->data == MAP_FAILED) {
+		wlr_log_errno(WLR_ERROR, "mmap failed");
+		close(slab->fd);
+		free(slab);
+		return NULL;
+	}
+
+	slab->allocator = allocator;
+	slab->size = size;
+	wl_array_init(&slab->free_chunks);
+	wl_list_insert(&allocator->slabs, &slab->link);
+
+	wlr_log(WLR_DEBUG, "Created shm slab of %zu bytes", size);
+	return slab;
+}
+
+static bool slab_alloc(struct wlr_shm_slab *slab, size_t size,
+		size_t *offset) {
+	// Freed chunks are only handed out again for buffers of the exact same
+	// size: swapchains allocate buffers of identical dimensions, and this
+	// keeps the slab from fragmenting
+	struct wlr_shm_chunk *chunks = slab->free_chunks.data;
+	size_t chunks_len = slab->free_chunks.size / sizeof(*chunks);
+	for (size_t i = 0; i < chunks_len; i++) {
+		if (chunks[i].size == size) {
+			*offset = chunks[i].offset;
+			chunks[i] = chunks[chunks_len - 1];
+			slab->free_chunks.size -= sizeof(*chunks);
+			return true;
+		}
+	}
+
+	if (slab->size - slab->used >= size) {
+		*offset = slab->used;
+		slab->used += size;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * Give back to the unused tail of the slab the free chunks which end there.
+ */
+static void slab_trim_free_chunks(struct wlr_shm_slab *slab) {
+	struct wlr_shm_chunk *chunks = slab->free_chunks.data;
+	size_t chunks_len = slab->free_chunks.size / sizeof(*chunks);
+	size_t i = 0;
+	while (i < chunks_len) {
+		if (chunks[i].offset + chunks[i].size != slab->used) {
+			i++;
+			continue;
+		}
+
+		slab->used = chunks[i].offset;
+		chunks[i] = chunks[chunks_len - 1];
+		chunks_len--;
+		// The new tail may match a chunk we already skipped
+		i = 0;
+	}
+	slab->free_chunks.size = chunks_len * sizeof(*chunks);
+}
+
+static void slab_free(struct wlr_shm_slab *slab, size_t offset, size_t size) {
+	assert(slab->n_buffers > 0);
+	slab->n_buffers--;
+
+	if (slab->allocator == NULL) {
+		if (slab->n_buffers == 0) {
+			slab_destroy(slab);
+		}
+		return;
+	}
+
+	if (slab->n_buffers == 0) {
+		// Keep a single empty slab around to serve the next allocations, e.g.
+		// when a swapchain is re-created after a mode change
+		struct wlr_shm_slab *other;
+		wl_list_for_each(other, &slab->allocator->slabs, link) {
+			if (other != slab && other->n_buffers == 0) {
+				slab_destroy(slab);
+				return;
+			}
+		}
+
+		slab->used = 0;
+		slab->free_chunks.size = 0;
+		return;
+	}
+
+	if (offset + size == slab->used) {
+		slab->used = offset;
+		slab_trim_free_chunks(slab);
+		return;
+	}
+
+	struct wlr_shm_chunk *chunk = wl_array_add(&slab->free_chunks,
+		sizeof(*chunk));
+	if (chunk == NULL) {
+		// The chunk is leaked until the slab is empty
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return;
+	}
+	*chunk = (struct wlr_shm_chunk){ .offset = offset, .size = size };
+}
+
 static void buffer_destroy(struct wlr_buffer *wlr_buffer) {
 	struct wlr_shm_buffer *buffer = shm_buffer_from_buffer(wlr_buffer);
-	munmap(buffer->data, buffer->size);
-	close(buffer->shm.fd);
+	slab_free(buffer->slab, buffer->shm.offset, buffer->size);
 	free(buffer);
 }
 
@@ -54,9 +186,22 @@ static const struct wlr_buffer_impl buffer_impl = {
 	.end_data_ptr_access = shm_buffer_end_data_ptr_access,
 };
 
+static struct wlr_shm_allocator *shm_allocator_from_allocator(
+		struct wlr_allocator *wlr_allocator) {
+	assert(wlr_allocator->impl == &allocator_impl);
+	return (struct wlr_shm_allocator *)wlr_allocator;
+}
+
+static size_t align_up(size_t value, size_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
 static struct wlr_buffer *allocator_create_buffer(
 		struct wlr_allocator *wlr_allocator, int width, int height,
 		const struct wlr_drm_format *format) {
+	struct wlr_shm_allocator *allocator =
+		shm_allocator_from_allocator(wlr_allocator);
+
 	const struct wlr_pixel_format_info *info =
 		drm_get_pixel_format_info(format->format);
 	if (info == NULL) {
@@ -64,42 +209,68 @@ static struct wlr_buffer *allocator_create_buffer(
 		return NULL;
 	}
 
+	// Rows are padded to 32 bits, which is what pixman and X11 expect. Each
+	// buffer starts on a page boundary within its slab.
+	int bytes_per_pixel = info->bpp / 8;
+	int stride = align_up(width * bytes_per_pixel, 4);
+	size_t size = align_up((size_t)stride * height, allocator->page_size);
+
 	struct wlr_shm_buffer *buffer = calloc(1, sizeof(*buffer));
 	if (buffer == NULL) {
 		return NULL;
 	}
 	wlr_buffer_init(&buffer->base, &buffer_impl, width, height);
 
-	// TODO: consider using a single file for multiple buffers
-	int bytes_per_pixel = info->bpp / 8;
-	int stride = width * bytes_per_pixel; // TODO: align?
-	buffer->size = stride * height;
-	buffer->shm.fd = allocate_shm_file(buffer->size);
-	if (buffer->shm.fd < 0) {
-		free(buffer);
-		return NULL;
+	struct wlr_shm_slab *slab;
+	size_t offset = 0;
+	bool found = false;
+	wl_list_for_each(slab, &allocator->slabs, link) {
+		if (slab_alloc(slab, size, &offset)) {
+			found = true;
+			break;
+		}
+	}
+	if (!found) {
+		size_t slab_size = size > SHM_SLAB_SIZE ? size : SHM_SLAB_SIZE;
+		slab = slab_create(allocator, slab_size);
+		if (slab == NULL || !slab_alloc(slab, size, &offset)) {
+			free(buffer);
+			return NULL;
+		}
 	}
+	slab->n_buffers++;
 
+	buffer->slab = slab;
+	buffer->size = size;
+	buffer->data = (char *)slab->data + offset;
+
+	buffer->shm.fd = slab->fd;
 	buffer->shm.format = format->format;
 	buffer->shm.width = width;
 	buffer->shm.height = height;
 	buffer->shm.stride = stride;
-	buffer->shm.offset = 0;
-
-	buffer->data = mmap(NULL, buffer->size, PROT_READ | PROT_WRITE, MAP_SHARED,
-		buffer->shm.fd, 0);
-	if (buffer->data == MAP_FAILED) {
-		wlr_log_errno(WLR_ERROR, "mmap failed");
-		close(buffer->shm.fd);
-		free(buffer);
-		return NULL;
-	}
+	buffer->shm.offset = offset;
 
 	return &buffer->base;
 }
 
 static void allocator_destroy(struct wlr_allocator *wlr_allocator) {
-	free(wlr_allocator);
+	struct wlr_shm_allocator *allocator =
+		shm_allocator_from_allocator(wlr_allocator);
+
+	// Slabs still in use are destroyed along with their last buffer
+	struct wlr_shm_slab *slab, *tmp;
+	wl_list_for_each_safe(slab, tmp, &allocator->slabs, link) {
+		if (slab->n_buffers == 0) {
+			slab_destroy(slab);
+		} else {
+			slab->allocator = NULL;
+			wl_list_remove(&slab->link);
+			wl_list_init(&slab->link);
+		}
+	}
+
+	free(allocator);
 }
 
 static const struct wlr_allocator_interface allocator_impl = {
@@ -115,6 +286,11 @@ struct wlr_allocator *wlr_shm_allocator_create(void) {
 	wlr_allocator_init(&allocator->base, &allocator_impl,
 		WLR_BUFFER_CAP_DATA_PTR | WLR_BUFFER_CAP_SHM);
 
+	wl_list_init(&allocator->slabs);
+
+	long page_size = sysconf(_SC_PAGESIZE);
+	allocator->page_size = page_size > 0 ? (size_t)page_size : 4096;
+
 	wlr_log(WLR_DEBUG, "Created shm allocator");
 	return &allocator->base;
 }
@@ -1,5 +1,7 @@
 #define _POSIX_C_SOURCE 200809L
 #include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <wlr/render/dmabuf.h>
 #include <wlr/util/log.h>
@@ -36,3 +38,47 @@ error:
 	dst->n_planes = 0;
 	return false;
 }
+
+bool dmabuf_get_key(const struct wlr_dmabuf_attributes *attribs,
+		struct dmabuf_key *key) {
+	*key = (struct dmabuf_key){
+		.width = attribs->width,
+		.height = attribs->height,
+		.format = attribs->format,
+		.modifier = attribs->modifier,
+		.n_planes = attribs->n_planes,
+	};
+
+	for (int i = 0; i < attribs->n_planes; i++) {
+		struct stat st;
+		if (fstat(attribs->fd[i], &st) != 0) {
+			wlr_log_errno(WLR_DEBUG, "fstat failed");
+			return false;
+		}
+		key->planes[i].dev = st.st_dev;
+		key->planes[i].ino = st.st_ino;
+		key->planes[i].offset = attribs->offset[i];
+		key->planes[i].stride = attribs->stride[i];
+	}
+
+	return true;
+}
+
+bool dmabuf_key_equal(const struct dmabuf_key *a, const struct dmabuf_key *b) {
+	if (a->width != b->width || a->height != b->height ||
+			a->format != b->format || a->modifier != b->modifier ||
+			a->n_planes != b->n_planes) {
+		return false;
+	}
+
+	for (int i = 0; i < a->n_planes; i++) {
+		if (a->planes[i].dev != b->planes[i].dev ||
+				a->planes[i].ino != b->planes[i].ino ||
+				a->planes[i].offset != b->planes[i].offset ||
+				a->planes[i].stride != b->planes[i].stride) {
+			return false;
+		}
+	}
+
+	return true;
+}
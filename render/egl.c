@@ -296,6 +296,14 @@ static bool egl_init_display(struct wlr_egl *egl, EGLDisplay display) {
 	egl->exts.EXT_create_context_robustness =
 		check_egl_ext(display_exts_str, "EGL_EXT_create_context_robustness");
 
+	if (check_egl_ext(display_exts_str, "EGL_ANDROID_native_fence_sync")) {
+		egl->exts.ANDROID_native_fence_sync = true;
+		load_egl_proc(&egl->procs.eglCreateSyncKHR, "eglCreateSyncKHR");
+		load_egl_proc(&egl->procs.eglDestroySyncKHR, "eglDestroySyncKHR");
+		load_egl_proc(&egl->procs.eglDupNativeFenceFDANDROID,
+			"eglDupNativeFenceFDANDROID");
+	}
+
 	const char *device_exts_str = NULL, *driver_name = NULL;
 	if (egl->exts.EXT_device_query) {
 		EGLAttrib device_attrib;
@@ -998,3 +1006,31 @@ int wlr_egl_dup_drm_fd(struct wlr_egl *egl) {
 
 	return render_fd;
 }
+
+EGLSyncKHR wlr_egl_create_native_fence(struct wlr_egl *egl) {
+	if (!egl->exts.ANDROID_native_fence_sync) {
+		return EGL_NO_SYNC_KHR;
+	}
+
+	EGLint attribs[] = {
+		EGL_SYNC_NATIVE_FENCE_FD_ANDROID, EGL_NO_NATIVE_FENCE_FD_ANDROID,
+		EGL_NONE,
+	};
+	EGLSyncKHR sync = egl->procs.eglCreateSyncKHR(egl->display,
+		EGL_SYNC_NATIVE_FENCE_ANDROID, attribs);
+	if (sync == EGL_NO_SYNC_KHR) {
+		wlr_log(WLR_ERROR, "eglCreateSyncKHR failed");
+	}
+	return sync;
+}
+
+int wlr_egl_export_sync_file(struct wlr_egl *egl, EGLSyncKHR sync) {
+	int fd = egl->procs.eglDupNativeFenceFDANDROID(egl->display, sync);
+	if (fd == EGL_NO_NATIVE_FENCE_FD_ANDROID) {
+		wlr_log(WLR_ERROR, "eglDupNativeFenceFDANDROID failed");
+		fd = -1;
+	}
+
+	egl->procs.eglDestroySyncKHR(egl->display, sync);
+	return fd;
+}
@@ -227,6 +227,9 @@ static bool gles2_begin(struct wlr_renderer *wlr_renderer, uint32_t width,
 		}
 	}
 
+	// Expire DMA-BUF imports of buffers gone since the last frames
+	gles2_dmabuf_cache_trim(renderer);
+
 	glViewport(0, 0, width, height);
 	renderer->viewport_width = width;
 	renderer->viewport_height = height;
@@ -251,6 +254,25 @@ static void gles2_end(struct wlr_renderer *wlr_renderer) {
     glFinish();
 }
 
+static int gles2_end_with_sync_file(struct wlr_renderer *wlr_renderer) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+
+	EGLSyncKHR sync = wlr_egl_create_native_fence(renderer->egl);
+	if (sync == EGL_NO_SYNC_KHR) {
+		glFinish();
+		return -1;
+	}
+
+	glFlush();
+
+	int sync_file_fd = wlr_egl_export_sync_file(renderer->egl, sync);
+	if (sync_file_fd < 0) {
+		glFinish();
+	}
+	return sync_file_fd;
+}
+
 static void gles2_clear(struct wlr_renderer *wlr_renderer,
 		const float color[static 4]) {
 	struct wlr_gles2_renderer *renderer =
@@ -538,6 +560,10 @@ static void gles2_destroy(struct wlr_renderer *wlr_renderer) {
 	glDeleteProgram(renderer->shaders.tex_ext.program);
 	pop_gles2_debug(renderer);
 
+	push_gles2_debug(renderer);
+	gles2_staging_finish(renderer);
+	pop_gles2_debug(renderer);
+
 	if (renderer->exts.KHR_debug) {
 		glDisable(GL_DEBUG_OUTPUT_KHR);
 		renderer->procs.glDebugMessageCallbackKHR(NULL, NULL);
@@ -558,6 +584,7 @@ static const struct wlr_renderer_impl renderer_impl = {
 	.bind_buffer = gles2_bind_buffer,
 	.begin = gles2_begin,
 	.end = gles2_end,
+	.end_with_sync_file = gles2_end_with_sync_file,
 	.clear = gles2_clear,
 	.scissor = gles2_scissor,
 	.render_subtexture_with_matrix = gles2_render_subtexture_with_matrix,
@@ -735,6 +762,7 @@ struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_egl *egl) {
 
 	wl_list_init(&renderer->buffers);
 	wl_list_init(&renderer->textures);
+	wl_list_init(&renderer->dmabuf_cache);
 
 	renderer->egl = egl;
 	renderer->exts_str = exts_str;
@@ -794,6 +822,23 @@ struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_egl *egl) {
 			"glEGLImageTargetRenderbufferStorageOES");
 	}
 
+	// Pixel unpack buffers, fences and buffer mapping are core in GLES 3.0
+	int gl_major = 0;
+	if (sscanf((const char *)glGetString(GL_VERSION), "OpenGL ES %d",
+			&gl_major) == 1 && gl_major >= 3) {
+		load_gl_proc(&renderer->procs.glMapBufferRange, "glMapBufferRange");
+		load_gl_proc(&renderer->procs.glUnmapBuffer, "glUnmapBuffer");
+		load_gl_proc(&renderer->procs.glFenceSync, "glFenceSync");
+		load_gl_proc(&renderer->procs.glClientWaitSync, "glClientWaitSync");
+		load_gl_proc(&renderer->procs.glDeleteSync, "glDeleteSync");
+
+		if (check_gl_ext(exts_str, "GL_EXT_buffer_storage")) {
+			renderer->exts.EXT_buffer_storage = true;
+			load_gl_proc(&renderer->procs.glBufferStorageEXT,
+				"glBufferStorageEXT");
+		}
+	}
+
 	if (check_gl_ext(exts_str, "GL_KHR_robustness")) {
 		GLint notif_strategy = 0;
 		glGetIntegerv(GL_RESET_NOTIFICATION_STRATEGY_KHR, &notif_strategy);
@@ -868,6 +913,8 @@ struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_egl *egl) {
 		renderer->shaders.tex_ext.tex_attrib = glGetAttribLocation(prog, "texcoord");
 	}
 
+	gles2_staging_init(renderer);
+
 	pop_gles2_debug(renderer);
 
 	wlr_egl_unset_current(renderer->egl);
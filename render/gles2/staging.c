@@ -0,0 +1,277 @@
+#include <assert.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <stdint.h>
+#include <string.h>
+#include <wlr/util/log.h>
+#include "render/gles2.h"
+
+// GLES 3.0 enums, not exposed by the GLES2 headers
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+#ifndef GL_UNPACK_ALIGNMENT
+#define GL_UNPACK_ALIGNMENT 0x0CF5
+#endif
+
+#define STAGING_RING_SIZE (16 * 1024 * 1024)
+#define STAGING_ALIGN 16
+// One second, uploads should never take that long
+#define STAGING_WAIT_TIMEOUT_NSEC 1000000000ull
+
+static size_t align_up(size_t value, size_t align) {
+	return (value + align - 1) / align * align;
+}
+
+void gles2_staging_init(struct wlr_gles2_renderer *renderer) {
+	struct wlr_gles2_staging_ring *ring = &renderer->staging;
+	if (renderer->procs.glMapBufferRange == NULL) {
+		return;
+	}
+
+	glGenBuffers(1, &ring->pbo);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring->pbo);
+
+	if (renderer->exts.EXT_buffer_storage) {
+		GLbitfield flags = GL_MAP_WRITE_BIT_EXT | GL_MAP_PERSISTENT_BIT_EXT |
+			GL_MAP_COHERENT_BIT_EXT;
+		renderer->procs.glBufferStorageEXT(GL_PIXEL_UNPACK_BUFFER,
+			STAGING_RING_SIZE, NULL, flags);
+		ring->map = renderer->procs.glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,
+			0, STAGING_RING_SIZE, flags);
+		if (ring->map == NULL) {
+			wlr_log(WLR_DEBUG, "Failed to persistently map staging buffer");
+		}
+	}
+	if (ring->map == NULL) {
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, STAGING_RING_SIZE, NULL,
+			GL_STREAM_DRAW);
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (glGetError() != GL_NO_ERROR) {
+		wlr_log(WLR_DEBUG, "Failed to create staging buffer, "
+			"uploading shm textures directly");
+		glDeleteBuffers(1, &ring->pbo);
+		*ring = (struct wlr_gles2_staging_ring){0};
+		return;
+	}
+
+	ring->size = STAGING_RING_SIZE;
+	wlr_log(WLR_DEBUG, "Using a %zu KiB %s staging buffer for shm uploads",
+		ring->size / 1024, ring->map != NULL ? "persistent" : "mapped");
+}
+
+static void delete_fences(struct wlr_gles2_renderer *renderer) {
+	struct wlr_gles2_staging_ring *ring = &renderer->staging;
+	for (size_t i = 0; i < GLES2_STAGING_SEGMENTS; i++) {
+		GLsync fence = ring->fences[i];
+		if (fence == NULL) {
+			continue;
+		}
+		// A fence may guard multiple segments
+		for (size_t j = i; j < GLES2_STAGING_SEGMENTS; j++) {
+			if (ring->fences[j] == fence) {
+				ring->fences[j] = NULL;
+			}
+		}
+		renderer->procs.glDeleteSync(fence);
+	}
+}
+
+void gles2_staging_finish(struct wlr_gles2_renderer *renderer) {
+	struct wlr_gles2_staging_ring *ring = &renderer->staging;
+	if (ring->pbo == 0) {
+		return;
+	}
+
+	delete_fences(renderer);
+
+	if (ring->map != NULL) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring->pbo);
+		renderer->procs.glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &ring->pbo);
+	*ring = (struct wlr_gles2_staging_ring){0};
+}
+
+static size_t segment_size(struct wlr_gles2_staging_ring *ring) {
+	return ring->size / GLES2_STAGING_SEGMENTS;
+}
+
+/**
+ * Wait until the GPU is done with the segments in [first, last], before the
+ * head enters them.
+ */
+static bool reclaim_segments(struct wlr_gles2_renderer *renderer,
+		size_t first, size_t last) {
+	struct wlr_gles2_staging_ring *ring = &renderer->staging;
+	for (size_t i = first; i <= last; i++) {
+		GLsync fence = ring->fences[i];
+		if (fence == NULL) {
+			continue;
+		}
+
+		GLenum ret = renderer->procs.glClientWaitSync(fence,
+			GL_SYNC_FLUSH_COMMANDS_BIT_APPLE, STAGING_WAIT_TIMEOUT_NSEC);
+		if (ret == GL_TIMEOUT_EXPIRED_APPLE || ret == GL_WAIT_FAILED_APPLE) {
+			wlr_log(WLR_ERROR, "Failed to wait for staging buffer upload");
+			return false;
+		}
+
+		// All segments sharing this fence were left at the same time
+		for (size_t j = 0; j < GLES2_STAGING_SEGMENTS; j++) {
+			if (ring->fences[j] == fence) {
+				ring->fences[j] = NULL;
+			}
+		}
+		renderer->procs.glDeleteSync(fence);
+	}
+
+	return true;
+}
+
+/**
+ * Guard the segments in [first, last], which the head has just left, with a
+ * single fence covering all uploads made so far.
+ */
+static void fence_segments(struct wlr_gles2_renderer *renderer,
+		size_t first, size_t last) {
+	struct wlr_gles2_staging_ring *ring = &renderer->staging;
+	GLsync fence = renderer->procs.glFenceSync(
+		GL_SYNC_GPU_COMMANDS_COMPLETE_APPLE, 0);
+	if (fence == NULL) {
+		// Can't track these uploads anymore, so wait for them right away
+		glFinish();
+		return;
+	}
+
+	for (size_t i = first; i <= last; i++) {
+		// Reclaimed when the head entered the segment
+		assert(ring->fences[i] == NULL);
+		ring->fences[i] = fence;
+	}
+}
+
+/**
+ * Start over from an idle ring after a failed upload, rather than tracking
+ * which segments are still guarded.
+ */
+static void reset_ring(struct wlr_gles2_renderer *renderer) {
+	struct wlr_gles2_staging_ring *ring = &renderer->staging;
+	glFinish();
+	delete_fences(renderer);
+	ring->head = 0;
+	ring->segment = 0;
+}
+
+bool gles2_staging_upload(struct wlr_gles2_renderer *renderer,
+		const struct wlr_gles2_pixel_format *fmt, uint32_t bytes_per_pixel,
+		const void *data, size_t stride, const pixman_region32_t *damage) {
+	struct wlr_gles2_staging_ring *ring = &renderer->staging;
+	if (ring->pbo == 0) {
+		return false;
+	}
+
+	int rects_len = 0;
+	const pixman_box32_t *rects = pixman_region32_rectangles(damage, &rects_len);
+	if (rects_len == 0) {
+		return true;
+	}
+
+	// Rows are packed tightly in the staging buffer
+	size_t len = 0;
+	for (int i = 0; i < rects_len; i++) {
+		const pixman_box32_t *rect = &rects[i];
+		size_t row_size = (size_t)(rect->x2 - rect->x1) * bytes_per_pixel;
+		len = align_up(len, STAGING_ALIGN) + row_size * (rect->y2 - rect->y1);
+	}
+	if (len > ring->size) {
+		return false;
+	}
+
+	// Only segments the head enters need to be waited on: the current one
+	// has no fence, and is only fenced once the head leaves it
+	size_t offset = align_up(ring->head, STAGING_ALIGN);
+	size_t first_new = ring->segment + 1;
+	if (offset + len > ring->size) {
+		fence_segments(renderer, ring->segment, ring->segment);
+		offset = 0;
+		first_new = 0;
+	}
+	size_t last = (offset + len - 1) / segment_size(ring);
+	if (first_new <= last && !reclaim_segments(renderer, first_new, last)) {
+		reset_ring(renderer);
+		return false;
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring->pbo);
+
+	unsigned char *dst;
+	if (ring->map != NULL) {
+		dst = (unsigned char *)ring->map + offset;
+	} else {
+		// The fences guarantee the range isn't in use anymore
+		dst = renderer->procs.glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,
+			offset, len, GL_MAP_WRITE_BIT_EXT | GL_MAP_UNSYNCHRONIZED_BIT_EXT |
+			GL_MAP_INVALIDATE_RANGE_BIT_EXT);
+		if (dst == NULL) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			reset_ring(renderer);
+			return false;
+		}
+	}
+
+	size_t pos = 0;
+	for (int i = 0; i < rects_len; i++) {
+		const pixman_box32_t *rect = &rects[i];
+		size_t row_size = (size_t)(rect->x2 - rect->x1) * bytes_per_pixel;
+		const unsigned char *src = (const unsigned char *)data +
+			(size_t)rect->y1 * stride + (size_t)rect->x1 * bytes_per_pixel;
+
+		pos = align_up(pos, STAGING_ALIGN);
+		for (int y = rect->y1; y < rect->y2; y++) {
+			memcpy(dst + pos, src, row_size);
+			pos += row_size;
+			src += stride;
+		}
+	}
+	assert(pos == len);
+
+	if (ring->map == NULL) {
+		renderer->procs.glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+
+	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, 0);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	// Walk the rects again with the same layout as above
+	pos = 0;
+	for (int i = 0; i < rects_len; i++) {
+		const pixman_box32_t *rect = &rects[i];
+		int width = rect->x2 - rect->x1;
+		int height = rect->y2 - rect->y1;
+
+		pos = align_up(pos, STAGING_ALIGN);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, rect->x1, rect->y1, width, height,
+			fmt->gl_format, fmt->gl_type, (const void *)(uintptr_t)(offset + pos));
+		pos += (size_t)width * bytes_per_pixel * height;
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	// The first segments the upload covers have been left behind
+	size_t first_left = first_new == 0 ? 0 : ring->segment;
+	if (first_left < last) {
+		fence_segments(renderer, first_left, last - 1);
+	}
+	ring->segment = last;
+	ring->head = offset + len;
+
+	return true;
+}
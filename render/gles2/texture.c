@@ -15,6 +15,7 @@
 #include "render/gles2.h"
 #include "render/pixel_format.h"
 #include "types/wlr_buffer.h"
+#include "util/time.h"
 
 static const struct wlr_texture_impl texture_impl;
 
@@ -28,11 +29,48 @@ struct wlr_gles2_texture *gles2_get_texture(
 	return (struct wlr_gles2_texture *)wlr_texture;
 }
 
+static bool gles2_texture_invalidate(struct wlr_gles2_texture *texture) {
+	if (texture->image == EGL_NO_IMAGE_KHR) {
+		return false;
+	}
+	if (texture->target == GL_TEXTURE_EXTERNAL_OES) {
+		// External changes are immediately made visible by the GL implementation
+		return true;
+	}
+
+	struct wlr_egl_context prev_ctx;
+	wlr_egl_save_context(&prev_ctx);
+	wlr_egl_make_current(texture->renderer->egl);
+
+	push_gles2_debug(texture->renderer);
+
+	glBindTexture(texture->target, texture->tex);
+	texture->renderer->procs.glEGLImageTargetTexture2DOES(texture->target,
+		texture->image);
+	glBindTexture(texture->target, 0);
+
+	pop_gles2_debug(texture->renderer);
+
+	wlr_egl_restore_context(&prev_ctx);
+
+	return true;
+}
+
 static bool gles2_texture_update_from_buffer(struct wlr_texture *wlr_texture,
 		struct wlr_buffer *buffer, const pixman_region32_t *damage) {
 	struct wlr_gles2_texture *texture = gles2_get_texture(wlr_texture);
 
-	if (texture->target != GL_TEXTURE_2D || texture->image != EGL_NO_IMAGE_KHR) {
+	if (texture->image != EGL_NO_IMAGE_KHR) {
+		// The buffer the texture was imported from has been committed again,
+		// some drivers need the EGLImage to be re-bound to pick up the new
+		// contents
+		if (buffer != texture->buffer) {
+			return false;
+		}
+		return gles2_texture_invalidate(texture);
+	}
+
+	if (texture->target != GL_TEXTURE_2D) {
 		return false;
 	}
 
@@ -70,25 +108,34 @@ static bool gles2_texture_update_from_buffer(struct wlr_texture *wlr_texture,
 
 	glBindTexture(GL_TEXTURE_2D, texture->tex);
 
-	int rects_len = 0;
-	const pixman_box32_t *rects = pixman_region32_rectangles(damage, &rects_len);
+	// The staging ring keeps a copy of the damage, so the buffer can be
+	// released before the GPU has consumed the upload
+	bool staged = gles2_staging_upload(texture->renderer, fmt,
+		drm_fmt->bpp / 8, data, stride, damage);
+	if (staged) {
+		wlr_buffer_end_data_ptr_access(buffer);
+	} else {
+		int rects_len = 0;
+		const pixman_box32_t *rects =
+			pixman_region32_rectangles(damage, &rects_len);
 
-	for (int i = 0; i < rects_len; i++) {
-		pixman_box32_t rect = rects[i];
+		for (int i = 0; i < rects_len; i++) {
+			pixman_box32_t rect = rects[i];
 
-		glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, stride / (drm_fmt->bpp / 8));
-		glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, rect.x1);
-		glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, rect.y1);
+			glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, stride / (drm_fmt->bpp / 8));
+			glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, rect.x1);
+			glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, rect.y1);
 
-		int width = rect.x2 - rect.x1;
-		int height = rect.y2 - rect.y1;
-		glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x1, rect.y1, width, height,
-			fmt->gl_format, fmt->gl_type, data);
-	}
+			int width = rect.x2 - rect.x1;
+			int height = rect.y2 - rect.y1;
+			glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x1, rect.y1, width, height,
+				fmt->gl_format, fmt->gl_type, data);
+		}
 
-	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
-	glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, 0);
-	glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, 0);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, 0);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, 0);
+	}
 
 	glBindTexture(GL_TEXTURE_2D, 0);
 
@@ -96,35 +143,10 @@ static bool gles2_texture_update_from_buffer(struct wlr_texture *wlr_texture,
 
 	wlr_egl_restore_context(&prev_ctx);
 
-	wlr_buffer_end_data_ptr_access(buffer);
-
-	return true;
-}
-
-static bool gles2_texture_invalidate(struct wlr_gles2_texture *texture) {
-	if (texture->image == EGL_NO_IMAGE_KHR) {
-		return false;
-	}
-	if (texture->target == GL_TEXTURE_EXTERNAL_OES) {
-		// External changes are immediately made visible by the GL implementation
-		return true;
+	if (!staged) {
+		wlr_buffer_end_data_ptr_access(buffer);
 	}
 
-	struct wlr_egl_context prev_ctx;
-	wlr_egl_save_context(&prev_ctx);
-	wlr_egl_make_current(texture->renderer->egl);
-
-	push_gles2_debug(texture->renderer);
-
-	glBindTexture(texture->target, texture->tex);
-	texture->renderer->procs.glEGLImageTargetTexture2DOES(texture->target,
-		texture->image);
-	glBindTexture(texture->target, 0);
-
-	pop_gles2_debug(texture->renderer);
-
-	wlr_egl_restore_context(&prev_ctx);
-
 	return true;
 }
 
@@ -133,6 +155,11 @@ void gles2_texture_destroy(struct wlr_gles2_texture *texture) {
 	if (texture->buffer != NULL) {
 		wlr_addon_finish(&texture->buffer_addon);
 	}
+	if (texture->cached) {
+		wl_list_remove(&texture->cache_link);
+		texture->renderer->dmabuf_cache_len--;
+		texture->renderer->dmabuf_cache_bytes -= texture->dmabuf_size;
+	}
 
 	struct wlr_egl_context prev_ctx;
 	wlr_egl_save_context(&prev_ctx);
@@ -299,10 +326,48 @@ static struct wlr_texture *gles2_texture_from_dmabuf(
 	return &texture->wlr_texture;
 }
 
+// Clients re-creating wl_buffers for the same DMA-BUFs would otherwise pay
+// for an import every time. Cached entries keep their DMA-BUF alive, so
+// they're bounded in count, size and age: clients re-create wl_buffers within
+// a few frames, anything older likely belongs to a client which is gone.
+#define DMABUF_CACHE_SIZE 8
+#define DMABUF_CACHE_MAX_BYTES (64 * 1024 * 1024)
+#define DMABUF_CACHE_MAX_AGE_MSEC 1000
+
+void gles2_dmabuf_cache_trim(struct wlr_gles2_renderer *renderer) {
+	int64_t now = get_current_time_msec();
+	while (!wl_list_empty(&renderer->dmabuf_cache)) {
+		struct wlr_gles2_texture *oldest = wl_container_of(
+			renderer->dmabuf_cache.prev, oldest, cache_link);
+		if (renderer->dmabuf_cache_len <= DMABUF_CACHE_SIZE &&
+				renderer->dmabuf_cache_bytes <= DMABUF_CACHE_MAX_BYTES &&
+				now - oldest->cached_msec <= DMABUF_CACHE_MAX_AGE_MSEC) {
+			break;
+		}
+		gles2_texture_destroy(oldest);
+	}
+}
+
 static void texture_handle_buffer_destroy(struct wlr_addon *addon) {
 	struct wlr_gles2_texture *texture =
 		wl_container_of(addon, texture, buffer_addon);
-	gles2_texture_destroy(texture);
+	if (!texture->has_dmabuf_key) {
+		gles2_texture_destroy(texture);
+		return;
+	}
+
+	// The EGLImage keeps the DMA-BUF alive, so its key stays unique
+	wlr_addon_finish(&texture->buffer_addon);
+	texture->buffer = NULL;
+
+	struct wlr_gles2_renderer *renderer = texture->renderer;
+	wl_list_insert(&renderer->dmabuf_cache, &texture->cache_link);
+	texture->cached = true;
+	texture->cached_msec = get_current_time_msec();
+	renderer->dmabuf_cache_len++;
+	renderer->dmabuf_cache_bytes += texture->dmabuf_size;
+
+	gles2_dmabuf_cache_trim(renderer);
 }
 
 static const struct wlr_addon_interface texture_addon_impl = {
@@ -326,13 +391,47 @@ static struct wlr_texture *gles2_texture_from_dmabuf_buffer(
 		return &texture->wlr_texture;
 	}
 
-	struct wlr_texture *wlr_texture =
-		gles2_texture_from_dmabuf(&renderer->wlr_renderer, dmabuf);
-	if (wlr_texture == NULL) {
-		return false;
+	struct dmabuf_key key;
+	bool has_key = dmabuf_get_key(dmabuf, &key);
+
+	struct wlr_gles2_texture *texture = NULL;
+	if (has_key) {
+		struct wlr_gles2_texture *iter;
+		wl_list_for_each(iter, &renderer->dmabuf_cache, cache_link) {
+			if (dmabuf_key_equal(&iter->dmabuf_key, &key)) {
+				texture = iter;
+				break;
+			}
+		}
+	}
+
+	if (texture != NULL) {
+		wl_list_remove(&texture->cache_link);
+		texture->cached = false;
+		renderer->dmabuf_cache_len--;
+		renderer->dmabuf_cache_bytes -= texture->dmabuf_size;
+
+		if (!gles2_texture_invalidate(texture)) {
+			wlr_log(WLR_ERROR, "Failed to invalidate texture");
+			gles2_texture_destroy(texture);
+			return false;
+		}
+	} else {
+		struct wlr_texture *wlr_texture =
+			gles2_texture_from_dmabuf(&renderer->wlr_renderer, dmabuf);
+		if (wlr_texture == NULL) {
+			return false;
+		}
+
+		texture = gles2_get_texture(wlr_texture);
+		texture->has_dmabuf_key = has_key;
+		texture->dmabuf_key = key;
+		// Chroma planes may be subsampled, this is an upper bound
+		for (int i = 0; i < dmabuf->n_planes; i++) {
+			texture->dmabuf_size += (size_t)dmabuf->stride[i] * dmabuf->height;
+		}
 	}
 
-	struct wlr_gles2_texture *texture = gles2_get_texture(wlr_texture);
 	texture->buffer = wlr_buffer_lock(buffer);
 	wlr_addon_init(&texture->buffer_addon, &buffer->addons,
 		renderer, &texture_addon_impl);
@@ -0,0 +1,357 @@
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <pixman.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wlr/interfaces/wlr_buffer.h>
+#include <wlr/util/log.h>
+#include "render/pixman.h"
+
+#define MAX_BANDS 64
+
+static void render_band(struct wlr_pixman_band *band) {
+	struct wlr_pixman_band_op *op;
+	wl_array_for_each(op, &band->ops) {
+		int rects_len;
+		const pixman_box32_t *rects =
+			pixman_region32_rectangles(&op->region, &rects_len);
+		for (int i = 0; i < rects_len; i++) {
+			const pixman_box32_t *rect = &rects[i];
+			pixman_image_composite32(op->op, op->src, op->mask, band->dst,
+				rect->x1 + op->src_dx, rect->y1 + op->src_dy, 0, 0,
+				rect->x1, rect->y1, rect->x2 - rect->x1, rect->y2 - rect->y1);
+		}
+	}
+}
+
+static void *band_thread(void *data) {
+	struct wlr_pixman_band *band = data;
+	struct wlr_pixman_bands *bands = band->bands;
+
+	// Threads are started before the first flush
+	uint64_t generation = 0;
+	pthread_mutex_lock(&bands->lock);
+	while (true) {
+		while (!bands->quit && bands->generation == generation) {
+			pthread_cond_wait(&bands->start_cond, &bands->lock);
+		}
+		if (bands->quit) {
+			break;
+		}
+		generation = bands->generation;
+		pthread_mutex_unlock(&bands->lock);
+
+		render_band(band);
+
+		pthread_mutex_lock(&bands->lock);
+		bands->pending--;
+		if (bands->pending == 0) {
+			pthread_cond_signal(&bands->done_cond);
+		}
+	}
+	pthread_mutex_unlock(&bands->lock);
+
+	return NULL;
+}
+
+static size_t get_threads_len(void) {
+	const char *env = getenv("WLR_PIXMAN_THREADS");
+	if (env == NULL) {
+		return 1;
+	}
+
+	char *end;
+	errno = 0;
+	long n = strtol(env, &end, 10);
+	if (errno != 0 || *end != '\0' || n < 1 || n > MAX_BANDS) {
+		wlr_log(WLR_ERROR, "Invalid WLR_PIXMAN_THREADS value, "
+			"expected an integer between 1 and %d", MAX_BANDS);
+		return 1;
+	}
+	return n;
+}
+
+static void stop_threads(struct wlr_pixman_bands *bands, size_t threads_len) {
+	pthread_mutex_lock(&bands->lock);
+	bands->quit = true;
+	pthread_cond_broadcast(&bands->start_cond);
+	pthread_mutex_unlock(&bands->lock);
+
+	// The first band doesn't have a thread
+	for (size_t i = 1; i <= threads_len; i++) {
+		pthread_join(bands->bands[i].thread, NULL);
+	}
+}
+
+struct wlr_pixman_bands *pixman_bands_create(void) {
+	size_t bands_len = get_threads_len();
+	if (bands_len <= 1) {
+		return NULL;
+	}
+
+	struct wlr_pixman_bands *bands = calloc(1, sizeof(*bands));
+	if (bands == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	bands->bands = calloc(bands_len, sizeof(bands->bands[0]));
+	if (bands->bands == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		free(bands);
+		return NULL;
+	}
+	bands->bands_len = bands_len;
+	wl_array_init(&bands->held_buffers);
+
+	pthread_mutex_init(&bands->lock, NULL);
+	pthread_cond_init(&bands->start_cond, NULL);
+	pthread_cond_init(&bands->done_cond, NULL);
+
+	for (size_t i = 0; i < bands_len; i++) {
+		struct wlr_pixman_band *band = &bands->bands[i];
+		band->bands = bands;
+		wl_array_init(&band->ops);
+	}
+
+	for (size_t i = 1; i < bands_len; i++) {
+		int ret = pthread_create(&bands->bands[i].thread, NULL, band_thread,
+			&bands->bands[i]);
+		if (ret != 0) {
+			wlr_log(WLR_ERROR, "pthread_create failed: %s", strerror(ret));
+			stop_threads(bands, i - 1);
+			pthread_cond_destroy(&bands->done_cond);
+			pthread_cond_destroy(&bands->start_cond);
+			pthread_mutex_destroy(&bands->lock);
+			free(bands->bands);
+			free(bands);
+			return NULL;
+		}
+	}
+
+	wlr_log(WLR_INFO, "Rendering with %zu pixman threads", bands_len);
+	return bands;
+}
+
+void pixman_bands_destroy(struct wlr_pixman_bands *bands) {
+	if (bands == NULL) {
+		return;
+	}
+
+	assert(!bands->recording);
+	stop_threads(bands, bands->bands_len - 1);
+
+	for (size_t i = 0; i < bands->bands_len; i++) {
+		wl_array_release(&bands->bands[i].ops);
+	}
+	wl_array_release(&bands->held_buffers);
+	pthread_cond_destroy(&bands->done_cond);
+	pthread_cond_destroy(&bands->start_cond);
+	pthread_mutex_destroy(&bands->lock);
+	free(bands->bands);
+	free(bands);
+}
+
+static void handle_clone_destroy(pixman_image_t *clone, void *data) {
+	pixman_image_t *image = data;
+	pixman_image_unref(image);
+}
+
+/**
+ * Create an image sharing the bits of another one, but with its own state.
+ * The original image is kept alive until the clone is destroyed.
+ */
+static pixman_image_t *clone_image(pixman_image_t *image) {
+	pixman_image_t *clone = pixman_image_create_bits_no_clear(
+		pixman_image_get_format(image), pixman_image_get_width(image),
+		pixman_image_get_height(image), pixman_image_get_data(image),
+		pixman_image_get_stride(image));
+	if (clone == NULL) {
+		return NULL;
+	}
+	pixman_image_set_destroy_function(clone, handle_clone_destroy,
+		pixman_image_ref(image));
+	return clone;
+}
+
+bool pixman_bands_begin(struct wlr_pixman_bands *bands, pixman_image_t *dst) {
+	assert(!bands->recording);
+
+	int height = pixman_image_get_height(dst);
+	int band_height = (height + bands->bands_len - 1) / bands->bands_len;
+	for (size_t i = 0; i < bands->bands_len; i++) {
+		struct wlr_pixman_band *band = &bands->bands[i];
+		band->y1 = i * band_height;
+		band->y2 = band->y1 + band_height;
+		if (band->y1 > height) {
+			band->y1 = height;
+		}
+		if (band->y2 > height) {
+			band->y2 = height;
+		}
+		band->dst = clone_image(dst);
+		if (band->dst == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create pixman image for band");
+			for (size_t j = 0; j < i; j++) {
+				pixman_image_unref(bands->bands[j].dst);
+				bands->bands[j].dst = NULL;
+			}
+			return false;
+		}
+	}
+
+	bands->recording = true;
+	return true;
+}
+
+void pixman_bands_composite(struct wlr_pixman_bands *bands, pixman_op_t op,
+		const struct wlr_pixman_band_src *src, float alpha, int src_dx, int src_dy,
+		const pixman_region32_t *region) {
+	assert(bands->recording);
+
+	for (size_t i = 0; i < bands->bands_len; i++) {
+		struct wlr_pixman_band *band = &bands->bands[i];
+		if (band->y1 == band->y2) {
+			continue;
+		}
+
+		pixman_region32_t band_region;
+		pixman_region32_init(&band_region);
+		pixman_region32_intersect_rect(&band_region, region,
+			0, band->y1, INT_MAX, band->y2 - band->y1);
+		if (!pixman_region32_not_empty(&band_region)) {
+			pixman_region32_fini(&band_region);
+			continue;
+		}
+
+		pixman_image_t *src_image;
+		if (src->image != NULL) {
+			src_image = clone_image(src->image);
+			if (src_image != NULL) {
+				pixman_image_set_transform(src_image, src->transform);
+				pixman_image_set_filter(src_image, src->filter, NULL, 0);
+			}
+		} else {
+			src_image = pixman_image_create_solid_fill(&src->color);
+		}
+
+		pixman_image_t *mask = NULL;
+		if (alpha != 1.0) {
+			struct pixman_color mask_color = { .alpha = 0xFFFF * alpha };
+			mask = pixman_image_create_solid_fill(&mask_color);
+		}
+
+		struct wlr_pixman_band_op *band_op = NULL;
+		if (src_image != NULL && (alpha == 1.0 || mask != NULL)) {
+			band_op = wl_array_add(&band->ops, sizeof(*band_op));
+		}
+		if (band_op == NULL) {
+			wlr_log(WLR_ERROR, "Failed to record pixman operation");
+			if (src_image != NULL) {
+				pixman_image_unref(src_image);
+			}
+			if (mask != NULL) {
+				pixman_image_unref(mask);
+			}
+			pixman_region32_fini(&band_region);
+			continue;
+		}
+
+		*band_op = (struct wlr_pixman_band_op){
+			.op = op,
+			.src = src_image,
+			.mask = mask,
+			.src_dx = src_dx,
+			.src_dy = src_dy,
+			.region = band_region,
+		};
+	}
+}
+
+bool pixman_bands_holds_buffer(struct wlr_pixman_bands *bands,
+		struct wlr_buffer *buffer) {
+	struct wlr_buffer **held;
+	wl_array_for_each(held, &bands->held_buffers) {
+		if (*held == buffer) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool pixman_bands_hold_buffer(struct wlr_pixman_bands *bands,
+		struct wlr_buffer *buffer) {
+	assert(!pixman_bands_holds_buffer(bands, buffer));
+
+	struct wlr_buffer **held = wl_array_add(&bands->held_buffers, sizeof(*held));
+	if (held == NULL) {
+		return false;
+	}
+	*held = wlr_buffer_lock(buffer);
+	return true;
+}
+
+void pixman_bands_flush(struct wlr_pixman_bands *bands) {
+	if (!bands->recording) {
+		return;
+	}
+
+	bool empty = true;
+	for (size_t i = 0; i < bands->bands_len; i++) {
+		if (bands->bands[i].ops.size > 0) {
+			empty = false;
+			break;
+		}
+	}
+
+	if (!empty) {
+		pthread_mutex_lock(&bands->lock);
+		bands->pending = bands->bands_len - 1;
+		bands->generation++;
+		pthread_cond_broadcast(&bands->start_cond);
+		pthread_mutex_unlock(&bands->lock);
+
+		render_band(&bands->bands[0]);
+
+		pthread_mutex_lock(&bands->lock);
+		while (bands->pending > 0) {
+			pthread_cond_wait(&bands->done_cond, &bands->lock);
+		}
+		pthread_mutex_unlock(&bands->lock);
+	}
+
+	for (size_t i = 0; i < bands->bands_len; i++) {
+		struct wlr_pixman_band *band = &bands->bands[i];
+		struct wlr_pixman_band_op *op;
+		wl_array_for_each(op, &band->ops) {
+			pixman_image_unref(op->src);
+			if (op->mask != NULL) {
+				pixman_image_unref(op->mask);
+			}
+			pixman_region32_fini(&op->region);
+		}
+		band->ops.size = 0;
+	}
+
+	struct wlr_buffer **held;
+	wl_array_for_each(held, &bands->held_buffers) {
+		wlr_buffer_end_data_ptr_access(*held);
+		wlr_buffer_unlock(*held);
+	}
+	bands->held_buffers.size = 0;
+}
+
+void pixman_bands_end(struct wlr_pixman_bands *bands) {
+	pixman_bands_flush(bands);
+
+	for (size_t i = 0; i < bands->bands_len; i++) {
+		struct wlr_pixman_band *band = &bands->bands[i];
+		if (band->dst != NULL) {
+			pixman_image_unref(band->dst);
+			band->dst = NULL;
+		}
+	}
+
+	bands->recording = false;
+}
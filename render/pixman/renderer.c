@@ -46,8 +46,37 @@ static struct wlr_pixman_texture *get_texture(
 	return (struct wlr_pixman_texture *)wlr_texture;
 }
 
+/**
+ * Get the bands recording the current rendering pass, if any.
+ */
+static struct wlr_pixman_bands *get_recording_bands(
+		struct wlr_pixman_renderer *renderer) {
+	if (renderer->bands == NULL || !renderer->bands->recording) {
+		return NULL;
+	}
+	return renderer->bands;
+}
+
+/**
+ * Recorded operations keep data pointer access to the buffers they read
+ * until they're flushed. Flush them before accessing such a buffer again.
+ */
+static void release_held_buffer(struct wlr_pixman_renderer *renderer,
+		struct wlr_buffer *buffer) {
+	if (renderer->bands != NULL &&
+			pixman_bands_holds_buffer(renderer->bands, buffer)) {
+		pixman_bands_flush(renderer->bands);
+	}
+}
+
 static void texture_destroy(struct wlr_texture *wlr_texture) {
 	struct wlr_pixman_texture *texture = get_texture(wlr_texture);
+	struct wlr_pixman_renderer *renderer = get_renderer(wlr_texture->renderer);
+	if (renderer->bands != NULL) {
+		// Recorded operations may still reference the texture's data
+		pixman_bands_flush(renderer->bands);
+	}
+
 	wl_list_remove(&texture->link);
 	pixman_image_unref(texture->image);
 	wlr_buffer_unlock(texture->buffer);
@@ -55,7 +84,58 @@ static void texture_destroy(struct wlr_texture *wlr_texture) {
 	free(texture);
 }
 
+static bool texture_update_from_buffer(struct wlr_texture *wlr_texture,
+		struct wlr_buffer *buffer, const pixman_region32_t *damage) {
+	struct wlr_pixman_texture *texture = get_texture(wlr_texture);
+	if (texture->data == NULL) {
+		// The texture references the memory of the buffer it was created from
+		return false;
+	}
+
+	struct wlr_pixman_renderer *renderer = get_renderer(wlr_texture->renderer);
+	if (renderer->bands != NULL) {
+		// Recorded operations may still read the texture's data
+		pixman_bands_flush(renderer->bands);
+	}
+
+	void *data;
+	uint32_t drm_format;
+	size_t stride;
+	if (!wlr_buffer_begin_data_ptr_access(buffer,
+			WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &drm_format, &stride)) {
+		return false;
+	}
+
+	bool ok = false;
+	if (drm_format != texture->format_info->drm_format) {
+		goto out;
+	}
+
+	pixman_image_t *src = pixman_image_create_bits_no_clear(texture->format,
+		buffer->width, buffer->height, data, stride);
+	if (src == NULL) {
+		goto out;
+	}
+
+	int rects_len = 0;
+	const pixman_box32_t *rects = pixman_region32_rectangles(damage, &rects_len);
+	for (int i = 0; i < rects_len; i++) {
+		const pixman_box32_t *rect = &rects[i];
+		pixman_image_composite32(PIXMAN_OP_SRC, src, NULL, texture->image,
+			rect->x1, rect->y1, 0, 0, rect->x1, rect->y1,
+			rect->x2 - rect->x1, rect->y2 - rect->y1);
+	}
+
+	pixman_image_unref(src);
+	ok = true;
+
+out:
+	wlr_buffer_end_data_ptr_access(buffer);
+	return ok;
+}
+
 static const struct wlr_texture_impl texture_impl = {
+	.update_from_buffer = texture_update_from_buffer,
 	.destroy = texture_destroy,
 };
 
@@ -132,6 +212,7 @@ static bool pixman_begin(struct wlr_renderer *wlr_renderer, uint32_t width,
 	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
 	renderer->width = width;
 	renderer->height = height;
+	renderer->has_scissor = false;
 
 	struct wlr_pixman_buffer *buffer = renderer->current_buffer;
 	assert(buffer != NULL);
@@ -162,6 +243,11 @@ static bool pixman_begin(struct wlr_renderer *wlr_renderer, uint32_t width,
 		buffer->image = image;
 	}
 
+	if (renderer->bands != NULL &&
+			!pixman_bands_begin(renderer->bands, buffer->image)) {
+		wlr_log(WLR_ERROR, "Falling back to single-threaded rendering");
+	}
+
 	return true;
 }
 
@@ -170,6 +256,10 @@ static void pixman_end(struct wlr_renderer *wlr_renderer) {
 
 	assert(renderer->current_buffer != NULL);
 
+	if (renderer->bands != NULL) {
+		pixman_bands_end(renderer->bands);
+	}
+
 	wlr_buffer_end_data_ptr_access(renderer->current_buffer->buffer);
 }
 
@@ -185,6 +275,23 @@ static void pixman_clear(struct wlr_renderer *wlr_renderer,
 		.alpha = color[3] * 0xFFFF,
 	};
 
+	struct wlr_pixman_bands *bands = get_recording_bands(renderer);
+	if (bands != NULL) {
+		pixman_region32_t region;
+		pixman_region32_init_rect(&region, 0, 0,
+			renderer->width, renderer->height);
+		if (renderer->has_scissor) {
+			const struct wlr_box *box = &renderer->scissor_box;
+			pixman_region32_intersect_rect(&region, &region,
+				box->x, box->y, box->width, box->height);
+		}
+		const struct wlr_pixman_band_src src = { .color = colour };
+		pixman_bands_composite(bands, PIXMAN_OP_SRC, &src, 1.0,
+			0, 0, &region);
+		pixman_region32_fini(&region);
+		return;
+	}
+
 	pixman_image_t *fill = pixman_image_create_solid_fill(&colour);
 
 	pixman_image_composite32(PIXMAN_OP_SRC, fill, NULL, buffer->image, 0, 0, 0,
@@ -198,7 +305,10 @@ static void pixman_scissor(struct wlr_renderer *wlr_renderer,
 	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
 	struct wlr_pixman_buffer *buffer = renderer->current_buffer;
 
+	renderer->has_scissor = box != NULL;
 	if (box != NULL) {
+		renderer->scissor_box = *box;
+
 		struct pixman_region32 region = {0};
 		pixman_region32_init_rect(&region, box->x, box->y, box->width,
 				box->height);
@@ -225,83 +335,81 @@ static void matrix_to_pixman_transform(struct pixman_transform *transform,
 	pixman_transform_from_pixman_f_transform(transform, &ftr);
 }
 
-static bool pixman_render_subtexture_with_matrix(
-		struct wlr_renderer *wlr_renderer, struct wlr_texture *wlr_texture,
-		const struct wlr_fbox *fbox, const float matrix[static 9],
-		float alpha) {
-	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
-	struct wlr_pixman_texture *texture = get_texture(wlr_texture);
-	struct wlr_pixman_buffer *buffer = renderer->current_buffer;
-
-	if (texture->buffer != NULL) {
-		void *data;
-		uint32_t drm_format;
-		size_t stride;
-		if (!wlr_buffer_begin_data_ptr_access(texture->buffer,
-				WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &drm_format, &stride)) {
-			return false;
-		}
-
-		// If the data pointer has changed, re-create the Pixman image. This can
-		// happen if it's a client buffer and the wl_shm_pool has been resized.
-		if (data != pixman_image_get_data(texture->image)) {
-			pixman_format_code_t format = get_pixman_format_from_drm(drm_format);
-			assert(format != 0);
-
-			pixman_image_unref(texture->image);
-			texture->image = pixman_image_create_bits_no_clear(format,
-				texture->wlr_texture.width, texture->wlr_texture.height,
-				data, stride);
-		}
+static bool texture_begin_access(struct wlr_pixman_texture *texture) {
+	if (texture->buffer == NULL) {
+		return true;
 	}
 
-	pixman_image_t *mask = NULL;
-	if (alpha != 1.0) {
-		struct pixman_color mask_colour = {0};
-		mask_colour.alpha = 0xFFFF * alpha;
-		mask = pixman_image_create_solid_fill(&mask_colour);
+	void *data;
+	uint32_t drm_format;
+	size_t stride;
+	if (!wlr_buffer_begin_data_ptr_access(texture->buffer,
+			WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &drm_format, &stride)) {
+		return false;
 	}
 
-	float m[9];
-	memcpy(m, matrix, sizeof(m));
-	wlr_matrix_scale(m, 1.0 / fbox->width, 1.0 / fbox->height);
-
-	struct pixman_transform transform = {0};
-	matrix_to_pixman_transform(&transform, m);
-	pixman_transform_invert(&transform, &transform);
+	// If the data pointer has changed, re-create the Pixman image. This can
+	// happen if it's a client buffer and the wl_shm_pool has been resized.
+	if (data != pixman_image_get_data(texture->image)) {
+		pixman_format_code_t format = get_pixman_format_from_drm(drm_format);
+		assert(format != 0);
 
-	pixman_image_set_transform(texture->image, &transform);
+		pixman_image_unref(texture->image);
+		texture->image = pixman_image_create_bits_no_clear(format,
+			texture->wlr_texture.width, texture->wlr_texture.height,
+			data, stride);
+	}
 
-	// TODO clip properly with src_x and src_y
-	pixman_image_composite32(PIXMAN_OP_OVER, texture->image, mask,
-			buffer->image, 0, 0, 0, 0, 0, 0, renderer->width,
-			renderer->height);
+	return true;
+}
 
+static void texture_end_access(struct wlr_pixman_texture *texture) {
 	if (texture->buffer != NULL) {
 		wlr_buffer_end_data_ptr_access(texture->buffer);
 	}
+}
 
-	if (mask != NULL) {
-		pixman_image_unref(mask);
+static pixman_image_t *create_alpha_mask(float alpha) {
+	if (alpha == 1.0) {
+		return NULL;
 	}
 
-	return true;
+	struct pixman_color mask_colour = {0};
+	mask_colour.alpha = 0xFFFF * alpha;
+	return pixman_image_create_solid_fill(&mask_colour);
 }
 
-static void pixman_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
-		const float color[static 4], const float matrix[static 9]) {
-	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
-	struct wlr_pixman_buffer *buffer = renderer->current_buffer;
+static void texture_get_transform(const struct wlr_fbox *fbox,
+		const float matrix[static 9], struct pixman_transform *transform) {
+	float m[9];
+	memcpy(m, matrix, sizeof(m));
+	wlr_matrix_scale(m, 1.0 / fbox->width, 1.0 / fbox->height);
 
-	struct pixman_color colour = {
+	*transform = (struct pixman_transform){0};
+	matrix_to_pixman_transform(transform, m);
+	pixman_transform_invert(transform, transform);
+}
+
+static struct pixman_color color_to_pixman(const float color[static 4]) {
+	return (struct pixman_color){
 		.red = color[0] * 0xFFFF,
 		.green = color[1] * 0xFFFF,
 		.blue = color[2] * 0xFFFF,
 		.alpha = color[3] * 0xFFFF,
 	};
+}
 
-	pixman_image_t *fill = pixman_image_create_solid_fill(&colour);
+static pixman_image_t *create_solid_fill(const float color[static 4]) {
+	struct pixman_color colour = color_to_pixman(color);
+	return pixman_image_create_solid_fill(&colour);
+}
 
+/**
+ * Create an image of the quad, with a transform mapping it to the render
+ * buffer. The transform is also returned.
+ */
+static pixman_image_t *create_quad_image(const float color[static 4],
+		const float matrix[static 9], struct pixman_transform *transform) {
 	float m[9];
 	memcpy(m, matrix, sizeof(m));
 
@@ -320,21 +428,274 @@ static void pixman_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
 	pixman_image_t *image = pixman_image_create_bits(PIXMAN_a8r8g8b8, width,
 			height, NULL, 0);
 
-	// TODO find a way to fill the image without allocating 2 images
-	pixman_image_composite32(PIXMAN_OP_SRC, fill, NULL, image,
-		0, 0, 0, 0, 0, 0, width, height);
-	pixman_image_unref(fill);
+	struct pixman_color colour = color_to_pixman(color);
+	pixman_box32_t box = { .x2 = width, .y2 = height };
+	pixman_image_fill_boxes(PIXMAN_OP_SRC, image, &colour, 1, &box);
+
+	*transform = (struct pixman_transform){0};
+	matrix_to_pixman_transform(transform, m);
+	pixman_transform_invert(transform, transform);
+
+	pixman_image_set_transform(image, transform);
+	return image;
+}
+
+/**
+ * Whether the matrix maps the unit square to a pixel-aligned rectangle, in
+ * which case it can be filled without a transform.
+ */
+static bool matrix_is_pixel_aligned(const float m[static 9]) {
+	return m[1] == 0.0 && m[3] == 0.0 &&
+		floorf(m[0]) == m[0] && floorf(m[4]) == m[4] &&
+		floorf(m[2]) == m[2] && floorf(m[5]) == m[5];
+}
+
+/**
+ * Get the region covered by the matrix applied to the unit square.
+ */
+static void matrix_get_bounds(const float m[static 9], pixman_box32_t *bounds) {
+	float xs[] = { m[2], m[0] + m[2], m[1] + m[2], m[0] + m[1] + m[2] };
+	float ys[] = { m[5], m[3] + m[5], m[4] + m[5], m[3] + m[4] + m[5] };
+
+	float x1 = xs[0], x2 = xs[0], y1 = ys[0], y2 = ys[0];
+	for (size_t i = 1; i < 4; i++) {
+		x1 = fminf(x1, xs[i]);
+		x2 = fmaxf(x2, xs[i]);
+		y1 = fminf(y1, ys[i]);
+		y2 = fmaxf(y2, ys[i]);
+	}
+
+	*bounds = (pixman_box32_t){
+		.x1 = floorf(x1),
+		.y1 = floorf(y1),
+		.x2 = ceilf(x2),
+		.y2 = ceilf(y2),
+	};
+}
+
+/**
+ * Get the part of the render buffer covered by the matrix applied to the unit
+ * square, restricted to the clip region (if any) and the scissor box. Returns
+ * false if nothing needs to be drawn.
+ */
+static bool get_draw_region(struct wlr_pixman_renderer *renderer,
+		const float matrix[static 9], const pixman_region32_t *clip,
+		pixman_region32_t *region) {
+	pixman_box32_t bounds;
+	matrix_get_bounds(matrix, &bounds);
+
+	pixman_region32_init_rect(region, 0, 0,
+		renderer->width, renderer->height);
+	pixman_region32_intersect_rect(region, region, bounds.x1, bounds.y1,
+		bounds.x2 - bounds.x1, bounds.y2 - bounds.y1);
+	if (clip != NULL) {
+		pixman_region32_intersect(region, region, clip);
+	}
+	if (renderer->has_scissor) {
+		const struct wlr_box *box = &renderer->scissor_box;
+		pixman_region32_intersect_rect(region, region,
+			box->x, box->y, box->width, box->height);
+	}
+
+	if (!pixman_region32_not_empty(region)) {
+		pixman_region32_fini(region);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Whether the matrix draws the source box 1:1 at an integer offset, in which
+ * case the texture can be copied without a transform. The offset from
+ * destination to texture coordinates is returned in dx, dy.
+ */
+static bool texture_matrix_get_offset(const struct wlr_fbox *fbox,
+		const float m[static 9], int *dx, int *dy) {
+	if (m[1] != 0.0 || m[3] != 0.0 ||
+			m[0] != fbox->width || m[4] != fbox->height) {
+		return false;
+	}
+
+	float x = fbox->x - m[2], y = fbox->y - m[5];
+	if (floorf(x) != x || floorf(y) != y) {
+		return false;
+	}
+
+	*dx = x;
+	*dy = y;
+	return true;
+}
+
+static bool composite_texture(struct wlr_pixman_renderer *renderer,
+		struct wlr_pixman_texture *texture, const struct wlr_fbox *fbox,
+		const float matrix[static 9], float alpha,
+		const pixman_region32_t *region) {
+	struct wlr_pixman_buffer *buffer = renderer->current_buffer;
+	struct wlr_pixman_bands *bands = get_recording_bands(renderer);
+
+	// Recorded operations keep the access until they're flushed
+	bool accessed = bands != NULL && texture->buffer != NULL &&
+		pixman_bands_holds_buffer(bands, texture->buffer);
+	if (!accessed && !texture_begin_access(texture)) {
+		return false;
+	}
+
+	int dx = 0, dy = 0;
+	struct pixman_transform transform;
+	const struct pixman_transform *transform_ptr = NULL;
+	if (!texture_matrix_get_offset(fbox, matrix, &dx, &dy)) {
+		texture_get_transform(fbox, matrix, &transform);
+		transform_ptr = &transform;
+	}
+	// Without a transform, pixman picks its unscaled blit paths
+	pixman_image_set_transform(texture->image, transform_ptr);
+	pixman_image_set_filter(texture->image, PIXMAN_FILTER_NEAREST, NULL, 0);
+
+	if (bands != NULL) {
+		const struct wlr_pixman_band_src src = {
+			.image = texture->image,
+			.transform = transform_ptr,
+			.filter = PIXMAN_FILTER_NEAREST,
+		};
+		pixman_bands_composite(bands, PIXMAN_OP_OVER, &src, alpha, dx, dy,
+			region);
+		if (!accessed && texture->buffer != NULL &&
+				!pixman_bands_hold_buffer(bands, texture->buffer)) {
+			// Can't defer the access, so render right away
+			pixman_bands_flush(bands);
+			texture_end_access(texture);
+		}
+		return true;
+	}
+
+	pixman_image_t *mask = create_alpha_mask(alpha);
+
+	int rects_len;
+	const pixman_box32_t *rects = pixman_region32_rectangles(region, &rects_len);
+	for (int i = 0; i < rects_len; i++) {
+		const pixman_box32_t *rect = &rects[i];
+		pixman_image_composite32(PIXMAN_OP_OVER, texture->image, mask,
+			buffer->image, rect->x1 + dx, rect->y1 + dy, 0, 0,
+			rect->x1, rect->y1, rect->x2 - rect->x1, rect->y2 - rect->y1);
+	}
+
+	if (mask != NULL) {
+		pixman_image_unref(mask);
+	}
+
+	texture_end_access(texture);
+	return true;
+}
+
+static void composite_quad(struct wlr_pixman_renderer *renderer,
+		const float color[static 4], const float matrix[static 9],
+		const pixman_region32_t *region) {
+	struct wlr_pixman_buffer *buffer = renderer->current_buffer;
+
+	struct wlr_pixman_bands *bands = get_recording_bands(renderer);
+	if (bands != NULL) {
+		struct wlr_pixman_band_src src = {
+			.color = color_to_pixman(color),
+			.filter = PIXMAN_FILTER_NEAREST,
+		};
+		pixman_image_t *quad = NULL;
+		struct pixman_transform transform;
+		if (!matrix_is_pixel_aligned(matrix)) {
+			quad = create_quad_image(color, matrix, &transform);
+			src.image = quad;
+			src.transform = &transform;
+		}
+		pixman_bands_composite(bands, PIXMAN_OP_OVER, &src, 1.0,
+			0, 0, region);
+		if (quad != NULL) {
+			// Kept alive by the recorded operations
+			pixman_image_unref(quad);
+		}
+		return;
+	}
+
+	pixman_image_t *src;
+	if (matrix_is_pixel_aligned(matrix)) {
+		// The region is already restricted to the quad
+		src = create_solid_fill(color);
+	} else {
+		struct pixman_transform transform;
+		src = create_quad_image(color, matrix, &transform);
+	}
+
+	int rects_len;
+	const pixman_box32_t *rects = pixman_region32_rectangles(region, &rects_len);
+	for (int i = 0; i < rects_len; i++) {
+		const pixman_box32_t *rect = &rects[i];
+		pixman_image_composite32(PIXMAN_OP_OVER, src, NULL, buffer->image,
+			rect->x1, rect->y1, 0, 0, rect->x1, rect->y1,
+			rect->x2 - rect->x1, rect->y2 - rect->y1);
+	}
+
+	pixman_image_unref(src);
+}
+
+static bool pixman_render_subtexture_with_matrix(
+		struct wlr_renderer *wlr_renderer, struct wlr_texture *wlr_texture,
+		const struct wlr_fbox *fbox, const float matrix[static 9],
+		float alpha) {
+	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
+	struct wlr_pixman_texture *texture = get_texture(wlr_texture);
+
+	pixman_region32_t region;
+	if (!get_draw_region(renderer, matrix, NULL, &region)) {
+		return true;
+	}
+
+	bool ok = composite_texture(renderer, texture, fbox, matrix, alpha,
+		&region);
+	pixman_region32_fini(&region);
+	return ok;
+}
+
+static void pixman_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
+		const float color[static 4], const float matrix[static 9]) {
+	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
+
+	pixman_region32_t region;
+	if (!get_draw_region(renderer, matrix, NULL, &region)) {
+		return;
+	}
+
+	composite_quad(renderer, color, matrix, &region);
+	pixman_region32_fini(&region);
+}
+
+static bool pixman_render_ops(struct wlr_renderer *wlr_renderer,
+		const struct wlr_render_op *ops, size_t ops_len) {
+	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
+	struct wlr_pixman_buffer *buffer = renderer->current_buffer;
+
+	// Each operation is composited once per rectangle it covers, instead of
+	// over the whole buffer with a clip region
+	pixman_image_set_clip_region32(buffer->image, NULL);
+	renderer->has_scissor = false;
 
-	struct pixman_transform transform = {0};
-	matrix_to_pixman_transform(&transform, m);
-	pixman_transform_invert(&transform, &transform);
+	bool ok = true;
+	for (size_t i = 0; i < ops_len; i++) {
+		const struct wlr_render_op *op = &ops[i];
 
-	pixman_image_set_transform(image, &transform);
+		pixman_region32_t region;
+		if (!get_draw_region(renderer, op->matrix, op->clip, &region)) {
+			continue;
+		}
 
-	pixman_image_composite32(PIXMAN_OP_OVER, image, NULL, buffer->image,
-			0, 0, 0, 0, 0, 0, renderer->width, renderer->height);
+		if (op->texture != NULL) {
+			ok = composite_texture(renderer, get_texture(op->texture),
+				&op->src_box, op->matrix, op->alpha, &region) && ok;
+		} else {
+			composite_quad(renderer, op->color, op->matrix, &region);
+		}
 
-	pixman_image_unref(image);
+		pixman_region32_fini(&region);
+	}
+
+	return ok;
 }
 
 static const uint32_t *pixman_get_shm_texture_formats(
@@ -384,6 +745,7 @@ static struct wlr_pixman_texture *pixman_texture_create(
 static struct wlr_texture *pixman_texture_from_buffer(
 		struct wlr_renderer *wlr_renderer, struct wlr_buffer *buffer) {
 	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
+	release_held_buffer(renderer, buffer);
 
 	void *data = NULL;
 	uint32_t drm_format;
@@ -414,6 +776,65 @@ static struct wlr_texture *pixman_texture_from_buffer(
 	return &texture->wlr_texture;
 }
 
+struct wlr_texture *pixman_texture_copy_from_buffer(
+		struct wlr_renderer *wlr_renderer, struct wlr_buffer *buffer) {
+	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
+	release_held_buffer(renderer, buffer);
+
+	void *data = NULL;
+	uint32_t drm_format;
+	size_t stride;
+	if (!wlr_buffer_begin_data_ptr_access(buffer, WLR_BUFFER_DATA_PTR_ACCESS_READ,
+			&data, &drm_format, &stride)) {
+		return NULL;
+	}
+
+	struct wlr_pixman_texture *texture = pixman_texture_create(renderer,
+		drm_format, buffer->width, buffer->height);
+	if (texture == NULL) {
+		goto error_access;
+	}
+
+	// pixman requires strides to be a multiple of 4 bytes
+	size_t copy_stride =
+		((size_t)buffer->width * texture->format_info->bpp / 8 + 3) & ~(size_t)3;
+	texture->data = malloc(copy_stride * buffer->height);
+	if (texture->data == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		goto error_texture;
+	}
+
+	texture->image = pixman_image_create_bits_no_clear(texture->format,
+		buffer->width, buffer->height, texture->data, copy_stride);
+	if (!texture->image) {
+		wlr_log(WLR_ERROR, "Failed to create pixman image");
+		goto error_texture;
+	}
+
+	pixman_image_t *src = pixman_image_create_bits_no_clear(texture->format,
+		buffer->width, buffer->height, data, stride);
+	if (!src) {
+		wlr_log(WLR_ERROR, "Failed to create pixman image");
+		pixman_image_unref(texture->image);
+		goto error_texture;
+	}
+	pixman_image_composite32(PIXMAN_OP_SRC, src, NULL, texture->image,
+		0, 0, 0, 0, 0, 0, buffer->width, buffer->height);
+	pixman_image_unref(src);
+
+	wlr_buffer_end_data_ptr_access(buffer);
+
+	return &texture->wlr_texture;
+
+error_texture:
+	wl_list_remove(&texture->link);
+	free(texture->data);
+	free(texture);
+error_access:
+	wlr_buffer_end_data_ptr_access(buffer);
+	return NULL;
+}
+
 static bool pixman_bind_buffer(struct wlr_renderer *wlr_renderer,
 		struct wlr_buffer *wlr_buffer) {
 	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
@@ -455,6 +876,7 @@ static void pixman_destroy(struct wlr_renderer *wlr_renderer) {
 	}
 
 	wlr_drm_format_set_finish(&renderer->drm_formats);
+	pixman_bands_destroy(renderer->bands);
 
 	free(renderer);
 }
@@ -477,6 +899,10 @@ static bool pixman_read_pixels(struct wlr_renderer *wlr_renderer,
 	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
 	struct wlr_pixman_buffer *buffer = renderer->current_buffer;
 
+	if (renderer->bands != NULL) {
+		pixman_bands_flush(renderer->bands);
+	}
+
 	pixman_format_code_t fmt = get_pixman_format_from_drm(drm_format);
 	if (fmt == 0) {
 		wlr_log(WLR_ERROR, "Cannot read pixels: unsupported pixel format");
@@ -509,6 +935,7 @@ static const struct wlr_renderer_impl renderer_impl = {
 	.scissor = pixman_scissor,
 	.render_subtexture_with_matrix = pixman_render_subtexture_with_matrix,
 	.render_quad_with_matrix = pixman_render_quad_with_matrix,
+	.render_ops = pixman_render_ops,
 	.get_shm_texture_formats = pixman_get_shm_texture_formats,
 	.get_render_formats = pixman_get_render_formats,
 	.texture_from_buffer = pixman_texture_from_buffer,
@@ -541,6 +968,8 @@ struct wlr_renderer *wlr_pixman_renderer_create(void) {
 			DRM_FORMAT_MOD_LINEAR);
 	}
 
+	renderer->bands = pixman_bands_create();
+
 	return &renderer->wlr_renderer;
 }
 
@@ -553,5 +982,9 @@ pixman_image_t *wlr_pixman_renderer_get_current_image(
 		struct wlr_renderer *wlr_renderer) {
 	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
 	assert(renderer->current_buffer);
+	// The caller may draw into the image directly
+	if (renderer->bands != NULL) {
+		pixman_bands_flush(renderer->bands);
+	}
 	return renderer->current_buffer->image;
 }
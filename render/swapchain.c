@@ -5,6 +5,7 @@
 #include <wlr/types/wlr_buffer.h>
 #include "render/allocator/allocator.h"
 #include "render/drm_format_set.h"
+#include "util/time.h"
 
 static void swapchain_handle_allocator_destroy(struct wl_listener *listener,
 		void *data) {
@@ -53,6 +54,9 @@ void wlr_swapchain_destroy(struct wlr_swapchain *swapchain) {
 	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
 		slot_reset(&swapchain->slots[i]);
 	}
+	if (swapchain->preallocate_idle != NULL) {
+		wl_event_source_remove(swapchain->preallocate_idle);
+	}
 	wl_list_remove(&swapchain->allocator_destroy.link);
 	free(swapchain->format);
 	free(swapchain);
@@ -65,16 +69,53 @@ static void slot_handle_release(struct wl_listener *listener, void *data) {
 	slot->acquired = false;
 }
 
+static bool slot_allocate(struct wlr_swapchain *swapchain,
+		struct wlr_swapchain_slot *slot) {
+	assert(slot->buffer == NULL);
+
+	if (swapchain->allocator == NULL) {
+		return false;
+	}
+
+	wlr_log(WLR_DEBUG, "Allocating new swapchain buffer");
+	slot->buffer = wlr_allocator_create_buffer(swapchain->allocator,
+		swapchain->width, swapchain->height, swapchain->format);
+	if (slot->buffer == NULL) {
+		wlr_log(WLR_ERROR, "Failed to allocate buffer");
+		return false;
+	}
+
+	slot->last_used_msec = get_current_time_msec();
+	swapchain->stats.allocations++;
+	return true;
+}
+
 static struct wlr_buffer *slot_acquire(struct wlr_swapchain *swapchain,
 		struct wlr_swapchain_slot *slot, int *age) {
 	assert(!slot->acquired);
 	assert(slot->buffer != NULL);
 
 	slot->acquired = true;
+	slot->last_used_msec = get_current_time_msec();
 
 	slot->release.notify = slot_handle_release;
 	wl_signal_add(&slot->buffer->events.release, &slot->release);
 
+	struct wlr_swapchain_stats *stats = &swapchain->stats;
+	stats->acquisitions++;
+	stats->acquisitions_by_age[slot->age < WLR_SWAPCHAIN_CAP ?
+		slot->age : WLR_SWAPCHAIN_CAP]++;
+
+	size_t acquired = 0;
+	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
+		if (swapchain->slots[i].acquired) {
+			acquired++;
+		}
+	}
+	if (acquired > stats->max_acquired) {
+		stats->max_acquired = acquired;
+	}
+
 	if (age != NULL) {
 		*age = slot->age;
 	}
@@ -100,18 +141,109 @@ struct wlr_buffer *wlr_swapchain_acquire(struct wlr_swapchain *swapchain,
 		return NULL;
 	}
 
-	if (swapchain->allocator == NULL) {
+	if (!slot_allocate(swapchain, free_slot)) {
 		return NULL;
 	}
+	return slot_acquire(swapchain, free_slot, age);
+}
 
-	wlr_log(WLR_DEBUG, "Allocating new swapchain buffer");
-	free_slot->buffer = wlr_allocator_create_buffer(swapchain->allocator,
-		swapchain->width, swapchain->height, swapchain->format);
-	if (free_slot->buffer == NULL) {
-		wlr_log(WLR_ERROR, "Failed to allocate buffer");
-		return NULL;
+static size_t swapchain_count_buffers(struct wlr_swapchain *swapchain) {
+	size_t count = 0;
+	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
+		if (swapchain->slots[i].buffer != NULL) {
+			count++;
+		}
+	}
+	return count;
+}
+
+static bool swapchain_preallocate_one(struct wlr_swapchain *swapchain) {
+	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
+		struct wlr_swapchain_slot *slot = &swapchain->slots[i];
+		if (slot->buffer == NULL) {
+			return slot_allocate(swapchain, slot);
+		}
+	}
+	return false;
+}
+
+bool wlr_swapchain_preallocate(struct wlr_swapchain *swapchain, size_t count) {
+	if (count > WLR_SWAPCHAIN_CAP) {
+		count = WLR_SWAPCHAIN_CAP;
+	}
+	while (swapchain_count_buffers(swapchain) < count) {
+		if (!swapchain_preallocate_one(swapchain)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void swapchain_handle_preallocate_idle(void *data) {
+	struct wlr_swapchain *swapchain = data;
+	swapchain->preallocate_idle = NULL;
+
+	if (swapchain_count_buffers(swapchain) >= swapchain->preallocate_count ||
+			!swapchain_preallocate_one(swapchain)) {
+		return;
+	}
+
+	if (swapchain_count_buffers(swapchain) < swapchain->preallocate_count) {
+		swapchain->preallocate_idle = wl_event_loop_add_idle(
+			swapchain->preallocate_loop, swapchain_handle_preallocate_idle,
+			swapchain);
+	}
+}
+
+void wlr_swapchain_preallocate_idle(struct wlr_swapchain *swapchain,
+		struct wl_event_loop *loop, size_t count) {
+	swapchain->preallocate_count =
+		count < WLR_SWAPCHAIN_CAP ? count : WLR_SWAPCHAIN_CAP;
+	swapchain->preallocate_loop = loop;
+
+	if (swapchain->preallocate_idle == NULL &&
+			swapchain_count_buffers(swapchain) < swapchain->preallocate_count) {
+		swapchain->preallocate_idle = wl_event_loop_add_idle(loop,
+			swapchain_handle_preallocate_idle, swapchain);
+	}
+}
+
+size_t wlr_swapchain_reclaim_idle(struct wlr_swapchain *swapchain,
+		int64_t idle_msec) {
+	int64_t now = get_current_time_msec();
+
+	size_t reclaimed = 0;
+	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
+		struct wlr_swapchain_slot *slot = &swapchain->slots[i];
+		if (slot->buffer == NULL || slot->acquired ||
+				now - slot->last_used_msec < idle_msec) {
+			continue;
+		}
+		slot_reset(slot);
+		reclaimed++;
+	}
+
+	if (reclaimed > 0) {
+		wlr_log(WLR_DEBUG, "Reclaimed %zu idle swapchain buffers", reclaimed);
+	}
+	swapchain->stats.reclaimed += reclaimed;
+	return reclaimed;
+}
+
+void wlr_swapchain_get_stats(const struct wlr_swapchain *swapchain,
+		struct wlr_swapchain_stats *stats) {
+	*stats = swapchain->stats;
+	stats->allocated = 0;
+	stats->acquired = 0;
+	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
+		const struct wlr_swapchain_slot *slot = &swapchain->slots[i];
+		if (slot->buffer != NULL) {
+			stats->allocated++;
+		}
+		if (slot->acquired) {
+			stats->acquired++;
+		}
 	}
-	return slot_acquire(swapchain, free_slot, age);
 }
 
 static bool swapchain_has_buffer(struct wlr_swapchain *swapchain,
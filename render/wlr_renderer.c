@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <wlr/render/allocator.h>
 #include <wlr/render/interface.h>
 #include <wlr/render/pixman.h>
 #include <wlr/render/wlr_renderer.h>
@@ -59,6 +60,7 @@ void wlr_renderer_destroy(struct wlr_renderer *r) {
 
 	wl_signal_emit_mutable(&r->events.destroy, r);
 	wl_list_remove(&r->multi_link);
+	wlr_allocator_destroy(r->mgpu_allocator);
 
 	if (r->impl && r->impl->destroy) {
 		r->impl->destroy(r);
@@ -114,6 +116,26 @@ void wlr_renderer_end(struct wlr_renderer *r) {
 	}
 }
 
+int renderer_end_with_sync_file(struct wlr_renderer *r) {
+	assert(r->rendering);
+
+	int sync_file_fd = -1;
+	if (r->impl->end_with_sync_file) {
+		sync_file_fd = r->impl->end_with_sync_file(r);
+	} else if (r->impl->end) {
+		r->impl->end(r);
+	}
+
+	r->rendering = false;
+
+	if (r->rendering_with_buffer) {
+		renderer_bind_buffer(r, NULL);
+		r->rendering_with_buffer = false;
+	}
+
+	return sync_file_fd;
+}
+
 void wlr_renderer_clear(struct wlr_renderer *r, const float color[static 4]) {
 	assert(r->rendering);
 	r->impl->clear(r, color);
@@ -180,6 +202,44 @@ void wlr_render_quad_with_matrix(struct wlr_renderer *r,
 	r->impl->render_quad_with_matrix(r, color, matrix);
 }
 
+bool wlr_renderer_render_ops(struct wlr_renderer *r,
+		const struct wlr_render_op *ops, size_t ops_len) {
+	assert(r->rendering);
+
+	if (r->impl->render_ops) {
+		return r->impl->render_ops(r, ops, ops_len);
+	}
+
+	bool ok = true;
+	for (size_t i = 0; i < ops_len; i++) {
+		const struct wlr_render_op *op = &ops[i];
+		assert(op->texture == NULL || op->texture->renderer == r);
+
+		int rects_len;
+		const pixman_box32_t *rects =
+			pixman_region32_rectangles(op->clip, &rects_len);
+		for (int j = 0; j < rects_len; j++) {
+			struct wlr_box box = {
+				.x = rects[j].x1,
+				.y = rects[j].y1,
+				.width = rects[j].x2 - rects[j].x1,
+				.height = rects[j].y2 - rects[j].y1,
+			};
+			r->impl->scissor(r, &box);
+
+			if (op->texture != NULL) {
+				ok = r->impl->render_subtexture_with_matrix(r, op->texture,
+					&op->src_box, op->matrix, op->alpha) && ok;
+			} else {
+				r->impl->render_quad_with_matrix(r, op->color, op->matrix);
+			}
+		}
+	}
+
+	r->impl->scissor(r, NULL);
+	return ok;
+}
+
 const uint32_t *wlr_renderer_get_shm_texture_formats(struct wlr_renderer *r,
 		size_t *len) {
 	return r->impl->get_shm_texture_formats(r, len);
@@ -3,13 +3,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <drm_fourcc.h>
+#include <wlr/render/allocator.h>
 #include <wlr/render/interface.h>
+#include <wlr/render/pixman.h>
 #include <wlr/render/wlr_texture.h>
 #include <wlr/types/wlr_matrix.h>
 #include "types/wlr_buffer.h"
 #include "backend/multi.h"
 #include "backend/drm/drm.h"
+#include "render/allocator/allocator.h"
 #include "render/drm_format_set.h"
+#include "render/pixman.h"
 #include "render/wlr_renderer.h"
 #include "render/egl.h"
 
@@ -124,6 +128,9 @@ static void handle_renderer_destroy(struct wl_listener *listener, void *data) {
 		wlr_texture_destroy(pair->texture);
 	}
 	pair->texture = NULL;
+	pair->linear = false;
+	pair->shared = false;
+	pixman_region32_clear(&pair->damage);
 	wl_list_remove(&pair->renderer_destroy.link);
 }
 
@@ -132,6 +139,7 @@ static void wlr_texture_set_init_pair(struct wlr_texture_set *set, int pair,
 	assert(pair < set->pairing_count);
 
 	set->pairings[pair].renderer = renderer;
+	pixman_region32_init(&set->pairings[pair].damage);
 	set->pairings[pair].renderer_destroy.notify = handle_renderer_destroy;
 	wl_signal_add(&renderer->events.destroy, &set->pairings[pair].renderer_destroy);
 }
@@ -144,6 +152,8 @@ struct wlr_texture_set *wlr_texture_set_from_renderer(struct wlr_renderer *rende
 	}
 	set->buffer = buffer;
 	set->native_pair = -1;
+	pixman_region32_init(&set->readback_damage);
+	pixman_region32_init(&set->linear_buffer_damage);
 
 	/*
 	 * If the renderer is part of a multi-GPU set, then use that list since it contains
@@ -179,6 +189,8 @@ struct wlr_texture_set *wlr_texture_set_from_renderer(struct wlr_renderer *rende
 	return set;
 
 fail:
+	pixman_region32_fini(&set->readback_damage);
+	pixman_region32_fini(&set->linear_buffer_damage);
 	free(set);
 	return NULL;
 }
@@ -231,71 +243,245 @@ fail:
 	return NULL;
 }
 
-static void *read_pixels(struct wlr_renderer *renderer, uint32_t format,
-		struct wlr_buffer *src_buffer) {
-	int stride = src_buffer->width * 4;
-	uint8_t *data = malloc(src_buffer->height * stride);
-	if (data == NULL) {
-		return false;
+static struct wlr_allocator *get_mgpu_allocator(struct wlr_renderer *renderer) {
+	if (renderer->mgpu_allocator == NULL && !renderer->mgpu_allocator_failed) {
+		int drm_fd = wlr_renderer_get_drm_fd(renderer);
+		if (drm_fd >= 0) {
+			renderer->mgpu_allocator = allocator_create_dmabuf_with_drm_fd(drm_fd);
+		}
+		renderer->mgpu_allocator_failed = renderer->mgpu_allocator == NULL;
 	}
+	return renderer->mgpu_allocator;
+}
 
-	struct wlr_buffer *src = wlr_buffer_lock(src_buffer);
-	if (!wlr_renderer_begin_with_buffer(renderer, src)) {
-		wlr_buffer_unlock(src);
+/*
+ * Blit the given region of the native texture into the linear DMA-BUF. The
+ * whole texture is blitted if the region is NULL.
+ */
+static bool blit_linear_buffer(struct wlr_texture_set *set,
+		const pixman_region32_t *region) {
+	struct wlr_texture_renderer_pair *native = &set->pairings[set->native_pair];
+	struct wlr_renderer *renderer = native->renderer;
+
+	float mat[9];
+	wlr_matrix_identity(mat);
+	wlr_matrix_scale(mat, set->width, set->height);
+
+	if (!wlr_renderer_begin_with_buffer(renderer, set->linear_buffer)) {
 		return false;
 	}
 
-	bool result = wlr_renderer_read_pixels(
-		renderer, DRM_FORMAT_ARGB8888,
-		stride, src->width, src->height, 0, 0, 0, 0,
-		data);
+	if (region == NULL) {
+		wlr_renderer_clear(renderer, (float[]){ 0.0, 0.0, 0.0, 0.0 });
+		wlr_render_texture_with_matrix(renderer, native->texture, mat, 1.0f);
+	} else {
+		int rects_len;
+		const pixman_box32_t *rects = pixman_region32_rectangles(region, &rects_len);
+		for (int i = 0; i < rects_len; i++) {
+			struct wlr_box box = {
+				.x = rects[i].x1,
+				.y = rects[i].y1,
+				.width = rects[i].x2 - rects[i].x1,
+				.height = rects[i].y2 - rects[i].y1,
+			};
+			wlr_renderer_scissor(renderer, &box);
+			wlr_renderer_clear(renderer, (float[]){ 0.0, 0.0, 0.0, 0.0 });
+			wlr_render_texture_with_matrix(renderer, native->texture, mat, 1.0f);
+		}
+		wlr_renderer_scissor(renderer, NULL);
+	}
 
 	wlr_renderer_end(renderer);
-	wlr_buffer_unlock(src);
+	return true;
+}
 
-	if (!result) {
-		free(data);
+static bool wlr_texture_set_get_linear_buffer(struct wlr_texture_set *set) {
+	if (set->linear_buffer) {
+		/* Only blit what changed since the last sync */
+		pixman_region32_intersect_rect(&set->linear_buffer_damage,
+			&set->linear_buffer_damage, 0, 0, set->width, set->height);
+		if (!pixman_region32_not_empty(&set->linear_buffer_damage)) {
+			return true;
+		}
+
+		if (!blit_linear_buffer(set, &set->linear_buffer_damage)) {
+			return false;
+		}
+
+		/* The importers may cache the DMA-BUF contents, refresh them */
+		bool ok = true;
+		for (int i = 0; i < set->pairing_count && ok; i++) {
+			struct wlr_texture_renderer_pair *pair = &set->pairings[i];
+			if (pair->texture && pair->shared) {
+				ok = wlr_texture_update_from_buffer(pair->texture,
+					set->linear_buffer, &set->linear_buffer_damage);
+			}
+		}
+
+		pixman_region32_clear(&set->linear_buffer_damage);
+		return ok;
+	}
+
+	/* Don't retry for every texture request if this doesn't work */
+	if (set->linear_buffer_failed) {
 		return false;
 	}
+	set->linear_buffer_failed = true;
 
-	return data;
+	struct wlr_renderer *native_renderer = set->pairings[set->native_pair].renderer;
+	struct wlr_allocator *allocator = get_mgpu_allocator(native_renderer);
+	if (!allocator) {
+		return false;
+	}
+
+	const struct wlr_drm_format_set *render_formats =
+		wlr_renderer_get_render_formats(native_renderer);
+	if (!render_formats || !wlr_drm_format_set_has(render_formats,
+			DRM_FORMAT_ARGB8888, DRM_FORMAT_MOD_LINEAR)) {
+		return false;
+	}
+
+	struct wlr_drm_format *format = wlr_drm_format_create(DRM_FORMAT_ARGB8888);
+	if (!format || !wlr_drm_format_add(&format, DRM_FORMAT_MOD_LINEAR)) {
+		free(format);
+		return false;
+	}
+
+	set->linear_buffer = wlr_allocator_create_buffer(allocator, set->width,
+		set->height, format);
+	free(format);
+	if (!set->linear_buffer) {
+		return false;
+	}
+
+	if (!blit_linear_buffer(set, NULL)) {
+		wlr_buffer_drop(set->linear_buffer);
+		set->linear_buffer = NULL;
+		return false;
+	}
+
+	pixman_region32_clear(&set->linear_buffer_damage);
+	set->linear_buffer_failed = false;
+	return true;
 }
 
-static bool get_drm_format(struct wlr_renderer *renderer, struct wlr_buffer *buffer,
-		uint32_t *format_out) {
-	/* Attach the original buffer for this set before doing renderer operations */
-	if (!wlr_renderer_begin_with_buffer(renderer, buffer)) {
+/*
+ * Read back the given region of the buffer into a linear ARGB8888 copy. The
+ * whole buffer is read if the region is NULL.
+ */
+static bool read_pixels(struct wlr_renderer *renderer, struct wlr_buffer *src_buffer,
+		void *data, const pixman_region32_t *region) {
+	int stride = src_buffer->width * 4;
+
+	struct wlr_buffer *src = wlr_buffer_lock(src_buffer);
+	if (!wlr_renderer_begin_with_buffer(renderer, src)) {
+		wlr_buffer_unlock(src);
 		return false;
 	}
 
-	*format_out = renderer->impl->preferred_read_format(renderer);
+	bool result = true;
+	if (region == NULL) {
+		result = wlr_renderer_read_pixels(renderer, DRM_FORMAT_ARGB8888,
+			stride, src->width, src->height, 0, 0, 0, 0, data);
+	} else {
+		int rects_len;
+		const pixman_box32_t *rects = pixman_region32_rectangles(region, &rects_len);
+		for (int i = 0; i < rects_len && result; i++) {
+			const pixman_box32_t *rect = &rects[i];
+			result = wlr_renderer_read_pixels(renderer, DRM_FORMAT_ARGB8888,
+				stride, rect->x2 - rect->x1, rect->y2 - rect->y1,
+				rect->x1, rect->y1, rect->x1, rect->y1, data);
+		}
+	}
 
 	wlr_renderer_end(renderer);
-	return true;
+	wlr_buffer_unlock(src);
+
+	return result;
 }
 
 static bool wlr_texture_set_get_linear_data(struct wlr_texture_set *set) {
 	struct wlr_renderer *native_renderer = set->pairings[set->native_pair].renderer;
-	struct wlr_texture *native_texture = set->pairings[set->native_pair].texture;
-	assert(native_texture);
+	assert(set->pairings[set->native_pair].texture);
 
 	if (set->pixel_data) {
+		/* Only read back what changed since the last sync */
+		pixman_region32_intersect_rect(&set->readback_damage, &set->readback_damage,
+			0, 0, set->width, set->height);
+		if (!pixman_region32_not_empty(&set->readback_damage)) {
+			return true;
+		}
+
+		if (!read_pixels(native_renderer, set->buffer, set->pixel_data,
+				&set->readback_damage)) {
+			return false;
+		}
+
+		pixman_region32_clear(&set->readback_damage);
 		return true;
 	}
 
-	/* Make a buffer with a linear layout and the same format */
-	if (!get_drm_format(native_renderer, set->buffer, &set->format)) {
+	/* Make a buffer with a linear layout */
+	set->format = DRM_FORMAT_ARGB8888;
+	set->pixel_data = malloc(set->height * set->width * 4);
+	if (!set->pixel_data) {
 		return false;
 	}
 
-	set->pixel_data = read_pixels(native_renderer, set->format, set->buffer);
-	if (!set->pixel_data) {
+	if (!read_pixels(native_renderer, set->buffer, set->pixel_data, NULL)) {
+		free(set->pixel_data);
+		set->pixel_data = NULL;
 		return false;
 	}
 
+	pixman_region32_clear(&set->readback_damage);
 	return true;
 }
 
+/*
+ * Bring a texture uploaded from the linear pixel data up to date, uploading
+ * only the damaged parts.
+ */
+static bool wlr_texture_set_sync_linear(struct wlr_texture_set *set,
+		struct wlr_texture_renderer_pair *pair) {
+	if (!pixman_region32_not_empty(&pair->damage)) {
+		return true;
+	}
+
+	if (!wlr_texture_set_get_linear_data(set)) {
+		return false;
+	}
+
+	uint32_t stride = set->width * 4;
+	struct wlr_readonly_data_buffer *buffer = readonly_data_buffer_create(set->format,
+		stride, set->width, set->height, set->pixel_data);
+	if (buffer == NULL) {
+		return false;
+	}
+
+	pixman_region32_intersect_rect(&pair->damage, &pair->damage,
+		0, 0, set->width, set->height);
+	bool ok = wlr_texture_update_from_buffer(pair->texture, &buffer->base,
+		&pair->damage);
+	if (!ok) {
+		/* The renderer can't update textures in place, upload a new one */
+		struct wlr_texture *texture =
+			wlr_texture_from_buffer(pair->renderer, &buffer->base);
+		if (texture) {
+			wlr_texture_destroy(pair->texture);
+			pair->texture = texture;
+			ok = true;
+		}
+	}
+
+	readonly_data_buffer_drop(buffer);
+
+	if (ok) {
+		pixman_region32_clear(&pair->damage);
+	}
+	return ok;
+}
+
 struct wlr_texture *wlr_texture_set_get_tex_for_renderer(struct wlr_texture_set *set,
 	struct wlr_renderer *renderer) {
 	/*
@@ -330,24 +516,49 @@ struct wlr_texture *wlr_texture_set_get_tex_for_renderer(struct wlr_texture_set
 
 	/* If we already have a texture for this renderer, return it */
 	if (pair->texture) {
+		if (pair->linear && !wlr_texture_set_sync_linear(set, pair)) {
+			goto fail;
+		}
+		if (pair->shared && !wlr_texture_set_get_linear_buffer(set)) {
+			goto fail;
+		}
 		goto success;
 	}
 
+	/* The contents only live in the existing textures anymore */
+	if (!set->buffer) {
+		goto fail;
+	}
+
 	/* first try to directly import the texture */
 	pair->texture = wlr_texture_from_buffer(renderer, set->buffer);
 	if (pair->texture) {
 		goto success;
 	}
 
-	/* Get our linear pixel data so we can import it into the target renderer */
+	/* Share a linear DMA-BUF copy made on the native GPU */
+	if (wlr_texture_set_get_linear_buffer(set)) {
+		pair->texture = wlr_texture_from_buffer(renderer, set->linear_buffer);
+		if (pair->texture) {
+			pair->shared = true;
+			goto success;
+		}
+	}
+
+	/*
+	 * As a last resort, get our linear pixel data so we can import it into
+	 * the target renderer
+	 */
 	if (!wlr_texture_set_get_linear_data(set)) {
 		goto fail;
 	}
 
 	/* import the linear texture into our renderer */
 	uint32_t stride = set->width * 4;
-	pair->texture = wlr_texture_from_pixels(renderer, DRM_FORMAT_ARGB8888, stride, set->width,
+	pair->texture = wlr_texture_from_pixels(renderer, set->format, stride, set->width,
 			set->height, set->pixel_data);
+	pair->linear = pair->texture != NULL;
+	pixman_region32_clear(&pair->damage);
 
 success:
 	wlr_egl_restore_context(&egl_context);
@@ -376,6 +587,47 @@ struct wlr_texture *wlr_texture_set_get_native_texture(struct wlr_texture_set *s
 
 bool wlr_texture_set_update_from_buffer(struct wlr_texture_set *set,
 		struct wlr_buffer *next, const pixman_region32_t *damage) {
+	/*
+	 * Textures imported from our own DMA-BUF alias its memory, but the
+	 * renderer may still need to refresh them. Record the damage so that the
+	 * linear copies can be synced on demand.
+	 */
+	struct wlr_dmabuf_attributes dmabuf;
+	if (next == set->buffer && wlr_buffer_get_dmabuf(next, &dmabuf)) {
+		for (int i = 0; i < set->pairing_count; i++) {
+			struct wlr_texture_renderer_pair *pair = &set->pairings[i];
+			if (!pair->texture || pair->linear || pair->shared) {
+				continue;
+			}
+			if (!wlr_texture_update_from_buffer(pair->texture, next, damage)) {
+				return false;
+			}
+		}
+
+		if (set->pixel_data) {
+			pixman_region32_union(&set->readback_damage, &set->readback_damage,
+				damage);
+		}
+		if (set->linear_buffer) {
+			pixman_region32_union(&set->linear_buffer_damage,
+				&set->linear_buffer_damage, damage);
+		}
+		for (int i = 0; i < set->pairing_count; i++) {
+			if (set->pairings[i].linear) {
+				pixman_region32_union(&set->pairings[i].damage,
+					&set->pairings[i].damage, damage);
+			}
+		}
+		return true;
+	}
+
+	/* The linear copies can't be synced from another buffer */
+	for (int i = 0; i < set->pairing_count; i++) {
+		if (set->pairings[i].linear || set->pairings[i].shared) {
+			return false;
+		}
+	}
+
 	/* Call wlr_texture_write_pixels on each valid texture in the set */
 	for (int i = 0; i < set->pairing_count; i++) {
 		if (set->pairings[i].texture) {
@@ -389,17 +641,63 @@ bool wlr_texture_set_update_from_buffer(struct wlr_texture_set *set,
 	return true;
 }
 
+bool wlr_texture_set_release_buffer(struct wlr_texture_set *set) {
+	if (set->buffer == NULL) {
+		return true;
+	}
+
+	/* Imported textures sample the DMA-BUF directly */
+	struct wlr_dmabuf_attributes dmabuf;
+	if (wlr_buffer_get_dmabuf(set->buffer, &dmabuf)) {
+		return false;
+	}
+
+	/* Missing and linear textures are created from the buffer lazily */
+	for (int i = 0; i < set->pairing_count; i++) {
+		struct wlr_texture_renderer_pair *pair = &set->pairings[i];
+		if (!pair->texture || pair->linear || pair->shared) {
+			return false;
+		}
+	}
+
+	/* GLES2 and Vulkan upload shm buffers, but pixman uses their memory */
+	for (int i = 0; i < set->pairing_count; i++) {
+		struct wlr_texture_renderer_pair *pair = &set->pairings[i];
+		if (!wlr_texture_is_pixman(pair->texture)) {
+			continue;
+		}
+
+		struct wlr_texture *copy =
+			pixman_texture_copy_from_buffer(pair->renderer, set->buffer);
+		if (!copy) {
+			return false;
+		}
+		wlr_texture_destroy(pair->texture);
+		pair->texture = copy;
+	}
+
+	wlr_buffer_unlock(set->buffer);
+	set->buffer = NULL;
+	return true;
+}
+
 void wlr_texture_set_destroy(struct wlr_texture_set *set) {
 	wlr_buffer_unlock(set->buffer);
 	free(set->pixel_data);
+	pixman_region32_fini(&set->readback_damage);
 
 	for (int i = 0; i < set->pairing_count; i++) {
 		wl_list_remove(&set->pairings[i].renderer_destroy.link);
+		pixman_region32_fini(&set->pairings[i].damage);
 		if (set->pairings[i].texture) {
 			wlr_texture_destroy(set->pairings[i].texture);
 		}
 	}
 
+	/* Textures imported from the linear DMA-BUF are gone by now */
+	wlr_buffer_drop(set->linear_buffer);
+	pixman_region32_fini(&set->linear_buffer_damage);
+
 	if (set) {
 		free(set->pairings);
 		free(set);
@@ -7,6 +7,7 @@
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/util/log.h>
+#include <wlr/util/region.h>
 #include "render/allocator/allocator.h"
 #include "types/wlr_buffer.h"
 #include "types/wlr_output.h"
@@ -55,27 +56,6 @@ void wlr_output_lock_software_cursors(struct wlr_output *output, bool lock) {
 	// again.
 }
 
-static void output_scissor(struct wlr_output *output, pixman_box32_t *rect) {
-	struct wlr_renderer *renderer = output->renderer;
-	assert(renderer);
-
-	struct wlr_box box = {
-		.x = rect->x1,
-		.y = rect->y1,
-		.width = rect->x2 - rect->x1,
-		.height = rect->y2 - rect->y1,
-	};
-
-	int ow, oh;
-	wlr_output_transformed_resolution(output, &ow, &oh);
-
-	enum wl_output_transform transform =
-		wlr_output_transform_invert(output->transform);
-	wlr_box_transform(&box, &box, transform, ow, oh);
-
-	wlr_renderer_scissor(renderer, &box);
-}
-
 /**
  * Returns the cursor box, scaled for its output.
  */
@@ -112,17 +92,25 @@ static void output_cursor_render(struct wlr_output_cursor *cursor,
 		goto surface_damage_finish;
 	}
 
-	float matrix[9];
-	wlr_matrix_project_box(matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL, 0,
+	int ow, oh;
+	wlr_output_transformed_resolution(cursor->output, &ow, &oh);
+
+	pixman_region32_t clip;
+	pixman_region32_init(&clip);
+	wlr_region_transform(&clip, &surface_damage,
+		wlr_output_transform_invert(cursor->output->transform), ow, oh);
+
+	struct wlr_render_op op = {
+		.texture = texture,
+		.src_box = { .width = texture->width, .height = texture->height },
+		.alpha = 1.0,
+		.clip = &clip,
+	};
+	wlr_matrix_project_box(op.matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL, 0,
 		cursor->output->transform_matrix);
 
-	int nrects;
-	pixman_box32_t *rects = pixman_region32_rectangles(&surface_damage, &nrects);
-	for (int i = 0; i < nrects; ++i) {
-		output_scissor(cursor->output, &rects[i]);
-		wlr_render_texture_with_matrix(renderer, texture, matrix, 1.0f);
-	}
-	wlr_renderer_scissor(renderer, NULL);
+	wlr_renderer_render_ops(renderer, &op, 1);
+	pixman_region32_fini(&clip);
 
 surface_damage_finish:
 	pixman_region32_fini(&surface_damage);
@@ -0,0 +1,227 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <time.h>
+#include <wlr/backend.h>
+#include <wlr/interfaces/wlr_output.h>
+#include <wlr/util/log.h>
+#include "types/wlr_output.h"
+#include "util/time.h"
+
+#define NSEC_PER_MSEC 1000000
+// Initial and minimum safety margin
+#define MIN_MARGIN_NSEC (1 * NSEC_PER_MSEC)
+// Don't extrapolate vblanks from presentation events older than this
+#define MAX_VBLANK_AGE_NSEC 1000000000
+
+static void deadline_reset(struct wlr_output_deadline *deadline) {
+	deadline->last_vblank_nsec = 0;
+	deadline->frame_nsec = 0;
+	deadline->target_nsec = 0;
+	deadline->missed = false;
+	deadline->durations_len = 0;
+	deadline->durations_index = 0;
+	deadline->margin_nsec = MIN_MARGIN_NSEC;
+}
+
+static int handle_timer(void *data) {
+	struct wlr_output *output = data;
+	struct wlr_output_deadline *deadline = &output->deadline;
+	deadline->deferred = false;
+
+	// Don't go through wlr_output_send_frame(), the deadline has been
+	// computed already
+	output->frame_pending = false;
+	if (output->enabled) {
+		deadline->frame_nsec = get_current_time_nsec();
+		wl_signal_emit_mutable(&output->events.frame, output);
+	}
+	return 0;
+}
+
+void wlr_output_set_deadline_scheduling(struct wlr_output *output,
+		bool enabled) {
+	struct wlr_output_deadline *deadline = &output->deadline;
+	if (deadline->enabled == enabled) {
+		return;
+	}
+
+	if (enabled && deadline->timer == NULL) {
+		struct wl_event_loop *ev = wl_display_get_event_loop(output->display);
+		deadline->timer = wl_event_loop_add_timer(ev, handle_timer, output);
+		if (deadline->timer == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create deadline timer");
+			return;
+		}
+	}
+
+	deadline_reset(deadline);
+	deadline->enabled = enabled;
+
+	if (!enabled && deadline->deferred) {
+		wl_event_source_timer_update(deadline->timer, 0);
+		deadline->deferred = false;
+		wlr_output_send_frame(output);
+	}
+}
+
+void output_deadline_finish(struct wlr_output *output) {
+	if (output->deadline.timer != NULL) {
+		wl_event_source_remove(output->deadline.timer);
+		output->deadline.timer = NULL;
+	}
+}
+
+static int64_t predict_duration(struct wlr_output_deadline *deadline) {
+	int64_t max = 0;
+	for (size_t i = 0; i < deadline->durations_len; i++) {
+		if (deadline->durations_nsec[i] > max) {
+			max = deadline->durations_nsec[i];
+		}
+	}
+	return max + deadline->margin_nsec;
+}
+
+bool output_deadline_defer_frame(struct wlr_output *output) {
+	struct wlr_output_deadline *deadline = &output->deadline;
+	if (!deadline->enabled || !output->enabled) {
+		return false;
+	}
+	if (deadline->deferred) {
+		// The timer will send the frame event
+		return true;
+	}
+
+	int64_t now = get_current_time_nsec();
+	int64_t refresh = deadline->refresh_nsec;
+	int64_t since_vblank = now - deadline->last_vblank_nsec;
+	if (deadline->last_vblank_nsec == 0 || refresh <= 0 ||
+			since_vblank < 0 || since_vblank > MAX_VBLANK_AGE_NSEC) {
+		deadline->target_nsec = 0;
+		return false;
+	}
+
+	int64_t next_vblank = deadline->last_vblank_nsec +
+		(since_vblank / refresh + 1) * refresh;
+	int64_t start = next_vblank - predict_duration(deadline);
+	if (start < now) {
+		// Too late for the next vblank, render right away for the one after
+		deadline->target_nsec = next_vblank + refresh;
+		deadline->missed = false;
+		return false;
+	}
+
+	deadline->target_nsec = next_vblank;
+
+	// Catch up right away after a missed deadline
+	if (deadline->missed) {
+		deadline->missed = false;
+		return false;
+	}
+
+	// Timers have millisecond granularity, round down to stay on the safe side
+	int delay_ms = (start - now) / NSEC_PER_MSEC;
+	if (delay_ms <= 0) {
+		return false;
+	}
+
+	wl_event_source_timer_update(deadline->timer, delay_ms);
+	deadline->deferred = true;
+	return true;
+}
+
+void output_deadline_handle_frame(struct wlr_output *output) {
+	struct wlr_output_deadline *deadline = &output->deadline;
+	if (!deadline->enabled) {
+		return;
+	}
+	deadline->frame_nsec = get_current_time_nsec();
+}
+
+void output_deadline_handle_commit(struct wlr_output *output,
+		const struct wlr_output_state *state) {
+	struct wlr_output_deadline *deadline = &output->deadline;
+	if (!deadline->enabled) {
+		return;
+	}
+
+	if ((state->committed & WLR_OUTPUT_STATE_ENABLED) && !state->enabled) {
+		deadline_reset(deadline);
+		return;
+	}
+	if (state->committed & WLR_OUTPUT_STATE_MODE) {
+		// The vblank timings and render durations are stale
+		deadline_reset(deadline);
+		return;
+	}
+
+	if (!(state->committed & WLR_OUTPUT_STATE_BUFFER) ||
+			deadline->frame_nsec == 0) {
+		return;
+	}
+
+	int64_t now = get_current_time_nsec();
+	int64_t duration = now - deadline->frame_nsec;
+	deadline->frame_nsec = 0;
+
+	// Renderers wait for the GPU before the buffer is committed, so this
+	// covers both CPU and GPU work. Durations longer than a refresh cycle are
+	// outliers (e.g. the compositor didn't render right away).
+	if (deadline->refresh_nsec > 0 && duration > deadline->refresh_nsec) {
+		return;
+	}
+
+	deadline->durations_nsec[deadline->durations_index] = duration;
+	deadline->durations_index =
+		(deadline->durations_index + 1) % WLR_OUTPUT_DEADLINE_HISTORY;
+	if (deadline->durations_len < WLR_OUTPUT_DEADLINE_HISTORY) {
+		deadline->durations_len++;
+	}
+
+	if (deadline->target_nsec == 0) {
+		return;
+	}
+
+	if (now > deadline->target_nsec) {
+		deadline->missed = true;
+		deadline->margin_nsec *= 2;
+		if (deadline->margin_nsec > deadline->refresh_nsec / 2) {
+			deadline->margin_nsec = deadline->refresh_nsec / 2;
+		}
+		wlr_log(WLR_DEBUG, "Output %s missed its frame deadline by %"PRId64" us, "
+			"margin is now %"PRId64" us", output->name,
+			(now - deadline->target_nsec) / 1000,
+			deadline->margin_nsec / 1000);
+	} else if (deadline->margin_nsec > MIN_MARGIN_NSEC) {
+		// Slowly shrink the margin back
+		deadline->margin_nsec -= (deadline->margin_nsec - MIN_MARGIN_NSEC) / 8 + 1;
+	}
+}
+
+void output_deadline_handle_present(struct wlr_output *output,
+		const struct wlr_output_event_present *event) {
+	struct wlr_output_deadline *deadline = &output->deadline;
+	if (!deadline->enabled || !event->presented || event->when == NULL) {
+		return;
+	}
+
+	// Tearing page-flips aren't aligned with the vblank grid
+	if (!(event->flags & WLR_OUTPUT_PRESENT_VSYNC)) {
+		return;
+	}
+
+	// Vblank timestamps are compared with our own clock
+	if (wlr_backend_get_presentation_clock(output->backend) != CLOCK_MONOTONIC) {
+		return;
+	}
+
+	deadline->last_vblank_nsec = timespec_to_nsec(event->when);
+	if (event->refresh > 0) {
+		deadline->refresh_nsec = event->refresh;
+	} else if (output->refresh > 0) {
+		deadline->refresh_nsec = 1000000000000ll / output->refresh;
+	} else {
+		deadline->refresh_nsec = 0;
+	}
+}
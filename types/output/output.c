@@ -409,6 +409,8 @@ void wlr_output_destroy(struct wlr_output *output) {
 		wl_event_source_remove(output->idle_done);
 	}
 
+	output_deadline_finish(output);
+
 	free(output->name);
 	free(output->description);
 	free(output->make);
@@ -726,88 +728,87 @@ bool wlr_output_test(struct wlr_output *output) {
 	return wlr_output_test_state(output, &state);
 }
 
-bool wlr_output_commit_state(struct wlr_output *output,
-		const struct wlr_output_state *state) {
+bool output_prepare_commit(struct wlr_output *output,
+		const struct wlr_output_state *state, struct wlr_output_state *pending,
+		bool *new_back_buffer) {
 	uint32_t unchanged = output_compare_state(output, state);
 
 	// Create a shallow copy of the state with only the fields which have been
 	// changed and potentially a new buffer.
-	struct wlr_output_state pending = *state;
-	pending.committed &= ~unchanged;
+	*pending = *state;
+	pending->committed &= ~unchanged;
 
-	if (!output_basic_test(output, &pending)) {
+	if (!output_basic_test(output, pending)) {
 		wlr_log(WLR_ERROR, "Basic output test failed for %s", output->name);
 		return false;
 	}
 
-	bool new_back_buffer = false;
-	if (!output_ensure_buffer(output, &pending, &new_back_buffer)) {
+	*new_back_buffer = false;
+	if (!output_ensure_buffer(output, pending, new_back_buffer)) {
 		return false;
 	}
-	if (new_back_buffer) {
-		assert((pending.committed & WLR_OUTPUT_STATE_BUFFER) == 0);
-		wlr_output_state_set_buffer(&pending, output->back_buffer);
+	if (*new_back_buffer) {
+		assert((pending->committed & WLR_OUTPUT_STATE_BUFFER) == 0);
+		wlr_output_state_set_buffer(pending, output->back_buffer);
 		output_clear_back_buffer(output);
 	}
 
-	if ((pending.committed & WLR_OUTPUT_STATE_BUFFER) &&
+	return true;
+}
+
+void output_precommit(struct wlr_output *output,
+		const struct wlr_output_state *pending, struct timespec *now) {
+	if ((pending->committed & WLR_OUTPUT_STATE_BUFFER) &&
 			output->idle_frame != NULL) {
 		wl_event_source_remove(output->idle_frame);
 		output->idle_frame = NULL;
 	}
 
-	struct timespec now;
-	clock_gettime(CLOCK_MONOTONIC, &now);
-
 	struct wlr_output_event_precommit pre_event = {
 		.output = output,
-		.when = &now,
-		.state = &pending,
+		.when = now,
+		.state = pending,
 	};
 	wl_signal_emit_mutable(&output->events.precommit, &pre_event);
+}
 
-	if (!output->impl->commit(output, &pending)) {
-		if (new_back_buffer) {
-			wlr_buffer_unlock(pending.buffer);
-		}
-		return false;
-	}
-
-	if (pending.committed & WLR_OUTPUT_STATE_BUFFER) {
+void output_apply_commit(struct wlr_output *output,
+		const struct wlr_output_state *pending, struct timespec *now) {
+	if (pending->committed & WLR_OUTPUT_STATE_BUFFER) {
 		struct wlr_output_cursor *cursor;
 		wl_list_for_each(cursor, &output->cursors, link) {
 			if (!cursor->enabled || !cursor->visible || cursor->surface == NULL) {
 				continue;
 			}
-			wlr_surface_send_frame_done(cursor->surface, &now);
+			wlr_surface_send_frame_done(cursor->surface, now);
 		}
 	}
 
-	if (pending.committed & WLR_OUTPUT_STATE_RENDER_FORMAT) {
-		output->render_format = pending.render_format;
+	if (pending->committed & WLR_OUTPUT_STATE_RENDER_FORMAT) {
+		output->render_format = pending->render_format;
 	}
 
-	if (pending.committed & WLR_OUTPUT_STATE_SUBPIXEL) {
-		output->subpixel = pending.subpixel;
+	if (pending->committed & WLR_OUTPUT_STATE_SUBPIXEL) {
+		output->subpixel = pending->subpixel;
 	}
 
 	output->commit_seq++;
 
-	if (pending.committed & WLR_OUTPUT_STATE_ENABLED) {
-		wlr_output_update_enabled(output, pending.enabled);
+	if (pending->committed & WLR_OUTPUT_STATE_ENABLED) {
+		wlr_output_update_enabled(output, pending->enabled);
 	}
 
-	bool scale_updated = pending.committed & WLR_OUTPUT_STATE_SCALE;
+	bool scale_updated = pending->committed & WLR_OUTPUT_STATE_SCALE;
 	if (scale_updated) {
-		output->scale = pending.scale;
+		output->scale = pending->scale;
 	}
 
-	if (pending.committed & WLR_OUTPUT_STATE_TRANSFORM) {
-		output->transform = pending.transform;
+	if (pending->committed & WLR_OUTPUT_STATE_TRANSFORM) {
+		output->transform = pending->transform;
 		output_update_matrix(output);
 	}
 
-	bool geometry_updated = pending.committed &
+	bool geometry_updated = pending->committed &
 		(WLR_OUTPUT_STATE_MODE | WLR_OUTPUT_STATE_TRANSFORM |
 		WLR_OUTPUT_STATE_SUBPIXEL);
 	if (geometry_updated || scale_updated) {
@@ -824,39 +825,64 @@ bool wlr_output_commit_state(struct wlr_output *output,
 	}
 
 	// Destroy the swapchains when an output is disabled
-	if ((pending.committed & WLR_OUTPUT_STATE_ENABLED) && !pending.enabled) {
+	if ((pending->committed & WLR_OUTPUT_STATE_ENABLED) && !pending->enabled) {
 		wlr_swapchain_destroy(output->swapchain);
 		output->swapchain = NULL;
 		wlr_swapchain_destroy(output->cursor_swapchain);
 		output->cursor_swapchain = NULL;
 	}
 
-	if (pending.committed & WLR_OUTPUT_STATE_BUFFER) {
+	if (pending->committed & WLR_OUTPUT_STATE_BUFFER) {
 		output->frame_pending = true;
 		output->needs_frame = false;
 	}
 
-	if (pending.committed & WLR_OUTPUT_STATE_LAYERS) {
+	output_deadline_handle_commit(output, pending);
+
+	if (pending->committed & WLR_OUTPUT_STATE_LAYERS) {
 		// Commit layer ordering
-		for (size_t i = 0; i < pending.layers_len; i++) {
-			struct wlr_output_layer *layer = pending.layers[i].layer;
+		for (size_t i = 0; i < pending->layers_len; i++) {
+			struct wlr_output_layer *layer = pending->layers[i].layer;
 			wl_list_remove(&layer->link);
 			wl_list_insert(output->layers.prev, &layer->link);
 		}
 	}
 
-	if ((pending.committed & WLR_OUTPUT_STATE_BUFFER) &&
+	if ((pending->committed & WLR_OUTPUT_STATE_BUFFER) &&
 			output->swapchain != NULL) {
-		wlr_swapchain_set_buffer_submitted(output->swapchain, pending.buffer);
+		wlr_swapchain_set_buffer_submitted(output->swapchain, pending->buffer);
 	}
 
 	struct wlr_output_event_commit event = {
 		.output = output,
-		.committed = pending.committed,
-		.when = &now,
-		.buffer = (pending.committed & WLR_OUTPUT_STATE_BUFFER) ? pending.buffer : NULL,
+		.committed = pending->committed,
+		.when = now,
+		.buffer = (pending->committed & WLR_OUTPUT_STATE_BUFFER) ? pending->buffer : NULL,
 	};
 	wl_signal_emit_mutable(&output->events.commit, &event);
+}
+
+bool wlr_output_commit_state(struct wlr_output *output,
+		const struct wlr_output_state *state) {
+	struct wlr_output_state pending;
+	bool new_back_buffer;
+	if (!output_prepare_commit(output, state, &pending, &new_back_buffer)) {
+		return false;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	output_precommit(output, &pending, &now);
+
+	if (!output->impl->commit(output, &pending)) {
+		if (new_back_buffer) {
+			wlr_buffer_unlock(pending.buffer);
+		}
+		return false;
+	}
+
+	output_apply_commit(output, &pending, &now);
 
 	if (new_back_buffer) {
 		wlr_buffer_unlock(pending.buffer);
@@ -895,8 +921,13 @@ void wlr_output_attach_buffer(struct wlr_output *output,
 }
 
 void wlr_output_send_frame(struct wlr_output *output) {
+	if (output_deadline_defer_frame(output)) {
+		return;
+	}
+
 	output->frame_pending = false;
 	if (output->enabled) {
+		output_deadline_handle_frame(output);
 		wl_signal_emit_mutable(&output->events.frame, output);
 	}
 }
@@ -943,6 +974,7 @@ void wlr_output_send_present(struct wlr_output *output,
 		event->when = &now;
 	}
 
+	output_deadline_handle_present(output, event);
 	wl_signal_emit_mutable(&output->events.present, event);
 }
 
@@ -103,6 +103,11 @@ bool wlr_output_configure_primary_swapchain(struct wlr_output *output,
 		}
 	}
 
+	// Allocate a second buffer while idle, so that the first frames after a
+	// mode set don't have to
+	wlr_swapchain_preallocate_idle(swapchain,
+		wl_display_get_event_loop(output->display), 2);
+
 	wlr_swapchain_destroy(*swapchain_ptr);
 	*swapchain_ptr = swapchain;
 	return true;
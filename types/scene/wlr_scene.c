@@ -1,5 +1,7 @@
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <wlr/backend.h>
@@ -8,17 +10,21 @@
 #include <wlr/types/wlr_damage_ring.h>
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/types/wlr_linux_dmabuf_v1.h>
+#include <wlr/types/wlr_output_layer.h>
 #include <wlr/types/wlr_presentation_time.h>
 #include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_single_pixel_buffer_v1.h>
 #include <wlr/util/log.h>
 #include <wlr/util/region.h>
 #include "types/wlr_buffer.h"
 #include "types/wlr_scene.h"
 #include "util/array.h"
+#include "util/box_tree.h"
 #include "util/env.h"
 #include "util/time.h"
 
 #define HIGHLIGHT_DAMAGE_FADEOUT_TIME 250
+#define SCENE_OUTPUT_MAX_LAYERS 4
 
 static struct wlr_scene_tree *scene_tree_from_node(struct wlr_scene_node *node) {
 	assert(node->type == WLR_SCENE_NODE_TREE);
@@ -54,20 +60,149 @@ struct wlr_scene *scene_node_get_root(struct wlr_scene_node *node) {
 	return (struct wlr_scene *)tree;
 }
 
+/*
+ * Leaf nodes carry sparse keys increasing in painter's order, so that the
+ * index can sort query results. Moving a sub-tree only re-keys its own
+ * leaves, in the gap between its new neighbours. The whole scene is only
+ * re-keyed when that gap is too small.
+ */
+#define SCENE_Z_ORDER_STRIDE (1ull << 32)
+
+static struct wlr_scene_node *scene_node_first_leaf(struct wlr_scene_node *node) {
+	if (node->type != WLR_SCENE_NODE_TREE) {
+		return node;
+	}
+	struct wlr_scene_tree *scene_tree = scene_tree_from_node(node);
+	struct wlr_scene_node *child;
+	wl_list_for_each(child, &scene_tree->children, link) {
+		struct wlr_scene_node *leaf = scene_node_first_leaf(child);
+		if (leaf != NULL) {
+			return leaf;
+		}
+	}
+	return NULL;
+}
+
+static struct wlr_scene_node *scene_node_last_leaf(struct wlr_scene_node *node) {
+	if (node->type != WLR_SCENE_NODE_TREE) {
+		return node;
+	}
+	struct wlr_scene_tree *scene_tree = scene_tree_from_node(node);
+	struct wlr_scene_node *child;
+	wl_list_for_each_reverse(child, &scene_tree->children, link) {
+		struct wlr_scene_node *leaf = scene_node_last_leaf(child);
+		if (leaf != NULL) {
+			return leaf;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Find the closest leaf below (or above if next is true) the node's sub-tree.
+ */
+static struct wlr_scene_node *scene_node_neighbour_leaf(
+		struct wlr_scene_node *node, bool next) {
+	for (; node->parent != NULL; node = &node->parent->node) {
+		struct wl_list *children = &node->parent->children;
+		struct wl_list *link = next ? node->link.next : node->link.prev;
+		for (; link != children; link = next ? link->next : link->prev) {
+			struct wlr_scene_node *sibling =
+				wl_container_of(link, sibling, link);
+			struct wlr_scene_node *leaf = next ?
+				scene_node_first_leaf(sibling) : scene_node_last_leaf(sibling);
+			if (leaf != NULL) {
+				return leaf;
+			}
+		}
+	}
+	return NULL;
+}
+
+static size_t scene_node_count_leaves(struct wlr_scene_node *node) {
+	if (node->type != WLR_SCENE_NODE_TREE) {
+		return 1;
+	}
+	size_t count = 0;
+	struct wlr_scene_tree *scene_tree = scene_tree_from_node(node);
+	struct wlr_scene_node *child;
+	wl_list_for_each(child, &scene_tree->children, link) {
+		count += scene_node_count_leaves(child);
+	}
+	return count;
+}
+
+static void scene_node_assign_z_order(struct wlr_scene_node *node,
+		uint64_t *z_order, uint64_t stride) {
+	if (node->type == WLR_SCENE_NODE_TREE) {
+		struct wlr_scene_tree *scene_tree = scene_tree_from_node(node);
+		struct wlr_scene_node *child;
+		wl_list_for_each(child, &scene_tree->children, link) {
+			scene_node_assign_z_order(child, z_order, stride);
+		}
+		return;
+	}
+
+	*z_order += stride;
+	node->z_order = *z_order;
+}
+
+/**
+ * Re-key the leaves of a node's sub-tree after it has been inserted at a new
+ * position in the scene-graph.
+ */
+static void scene_node_update_z_order(struct wlr_scene_node *node) {
+	size_t leaves_len = scene_node_count_leaves(node);
+	if (leaves_len == 0) {
+		return;
+	}
+
+	struct wlr_scene_node *prev = scene_node_neighbour_leaf(node, false);
+	struct wlr_scene_node *next = scene_node_neighbour_leaf(node, true);
+	uint64_t lo = prev != NULL ? prev->z_order : 0;
+	uint64_t hi = next != NULL ? next->z_order : UINT64_MAX;
+
+	// Keep a regular stride when appending, which is the common case
+	uint64_t stride = (hi - lo) / (leaves_len + 1);
+	if (next == NULL && stride > SCENE_Z_ORDER_STRIDE) {
+		stride = SCENE_Z_ORDER_STRIDE;
+	}
+
+	if (stride > 0) {
+		uint64_t z_order = lo;
+		scene_node_assign_z_order(node, &z_order, stride);
+		return;
+	}
+
+	struct wlr_scene *scene = scene_node_get_root(node);
+	size_t total = scene_node_count_leaves(&scene->tree.node);
+	stride = UINT64_MAX / (total + 1);
+	if (stride > SCENE_Z_ORDER_STRIDE) {
+		stride = SCENE_Z_ORDER_STRIDE;
+	}
+	uint64_t z_order = 0;
+	scene_node_assign_z_order(&scene->tree.node, &z_order, stride);
+}
+
 static void scene_node_init(struct wlr_scene_node *node,
 		enum wlr_scene_node_type type, struct wlr_scene_tree *parent) {
 	memset(node, 0, sizeof(*node));
 	node->type = type;
 	node->parent = parent;
 	node->enabled = true;
+	node->index_leaf = -1;
 
 	wl_list_init(&node->link);
+	wl_list_init(&node->update_link);
 
 	wl_signal_init(&node->events.destroy);
 	pixman_region32_init(&node->visible);
 
 	if (parent != NULL) {
 		wl_list_insert(parent->children.prev, &node->link);
+		if (type != WLR_SCENE_NODE_TREE) {
+			scene_node_update_z_order(node);
+		}
 	}
 
 	wlr_addon_set_init(&node->addons);
@@ -131,8 +266,21 @@ void wlr_scene_node_destroy(struct wlr_scene_node *node) {
 				&scene_tree->children, link) {
 			wlr_scene_node_destroy(child);
 		}
+
+		if (scene_tree == &scene->tree) {
+			box_tree_finish(scene->node_index);
+			free(scene->node_index);
+			wl_array_release(&scene->node_index_hits);
+			pixman_region32_fini(&scene->pending_update);
+			pixman_region32_fini(&scene->pending_damage);
+		}
 	}
 
+	if (node->index_leaf >= 0) {
+		box_tree_remove(scene->node_index, node->index_leaf);
+	}
+
+	wl_list_remove(&node->update_link);
 	wl_list_remove(&node->link);
 	pixman_region32_fini(&node->visible);
 	free(node);
@@ -151,9 +299,20 @@ struct wlr_scene *wlr_scene_create(void) {
 		return NULL;
 	}
 
+	scene->node_index = calloc(1, sizeof(*scene->node_index));
+	if (scene->node_index == NULL) {
+		free(scene);
+		return NULL;
+	}
+	box_tree_init(scene->node_index);
+	wl_array_init(&scene->node_index_hits);
+
 	scene_tree_init(&scene->tree, NULL);
 
 	wl_list_init(&scene->outputs);
+	wl_list_init(&scene->update_nodes);
+	pixman_region32_init(&scene->pending_update);
+	pixman_region32_init(&scene->pending_damage);
 	wl_list_init(&scene->presentation_destroy.link);
 	wl_list_init(&scene->linux_dmabuf_v1_destroy.link);
 
@@ -167,6 +326,8 @@ struct wlr_scene *wlr_scene_create(void) {
 	scene->debug_damage_option = env_parse_switch("WLR_SCENE_DEBUG_DAMAGE", debug_damage_options);
 	scene->direct_scanout = !env_parse_bool("WLR_SCENE_DISABLE_DIRECT_SCANOUT");
 	scene->calculate_visibility = !env_parse_bool("WLR_SCENE_DISABLE_VISIBILITY");
+	scene->output_layers = env_parse_bool("WLR_SCENE_ENABLE_OUTPUT_LAYERS");
+	scene->timing_log = env_parse_bool("WLR_SCENE_TIMING_LOG");
 
 	return scene;
 }
@@ -219,14 +380,118 @@ static bool _scene_nodes_in_box(struct wlr_scene_node *node, struct wlr_box *box
 	return false;
 }
 
+struct scene_index_hit {
+	struct wlr_scene_node *node;
+	int lx, ly;
+};
+
+static bool scene_index_query_iterator(void *data, const struct wlr_box *box,
+		void *user_data) {
+	struct wl_array *hits = user_data;
+
+	struct scene_index_hit *hit = wl_array_add(hits, sizeof(*hit));
+	if (hit) {
+		hit->node = data;
+		hit->lx = box->x;
+		hit->ly = box->y;
+	}
+	return false;
+}
+
+static int scene_index_hit_cmp(const void *_a, const void *_b) {
+	const struct scene_index_hit *a = _a, *b = _b;
+	// Topmost nodes come first
+	if (a->node->z_order == b->node->z_order) {
+		return 0;
+	}
+	return a->node->z_order > b->node->z_order ? -1 : 1;
+}
+
+static bool scene_index_nodes_in_box(struct wlr_scene *scene,
+		struct wlr_box *box, scene_node_box_iterator_func_t iterator,
+		void *user_data) {
+	// Iterators may query the scene again, only the outermost query can use
+	// the scratch array
+	struct wl_array local_hits;
+	struct wl_array *hits = &scene->node_index_hits;
+	if (scene->node_index_querying) {
+		wl_array_init(&local_hits);
+		hits = &local_hits;
+	}
+	bool outermost = !scene->node_index_querying;
+	scene->node_index_querying = true;
+
+	hits->size = 0;
+	box_tree_query(scene->node_index, box, scene_index_query_iterator, hits);
+
+	size_t len = hits->size / sizeof(struct scene_index_hit);
+	if (len > 1) {
+		qsort(hits->data, len, sizeof(struct scene_index_hit),
+			scene_index_hit_cmp);
+	}
+
+	bool found = false;
+	for (size_t i = 0; i < len; i++) {
+		struct scene_index_hit *hit = &((struct scene_index_hit *)hits->data)[i];
+		if (iterator(hit->node, hit->lx, hit->ly, user_data)) {
+			found = true;
+			break;
+		}
+	}
+
+	if (outermost) {
+		scene->node_index_querying = false;
+	} else {
+		wl_array_release(&local_hits);
+	}
+	return found;
+}
+
 static bool scene_nodes_in_box(struct wlr_scene_node *node, struct wlr_box *box,
 		scene_node_box_iterator_func_t iterator, void *user_data) {
+	if (node->parent == NULL) {
+		struct wlr_scene *scene = scene_node_get_root(node);
+		return scene_index_nodes_in_box(scene, box, iterator, user_data);
+	}
+
 	int x, y;
 	wlr_scene_node_coords(node, &x, &y);
 
 	return _scene_nodes_in_box(node, box, iterator, user_data, x, y);
 }
 
+static void scene_node_update_index(struct wlr_scene *scene,
+		struct wlr_scene_node *node, int lx, int ly, bool enabled) {
+	enabled = enabled && node->enabled;
+
+	if (node->type == WLR_SCENE_NODE_TREE) {
+		struct wlr_scene_tree *scene_tree = scene_tree_from_node(node);
+		struct wlr_scene_node *child;
+		wl_list_for_each(child, &scene_tree->children, link) {
+			scene_node_update_index(scene, child,
+				lx + child->x, ly + child->y, enabled);
+		}
+		return;
+	}
+
+	struct wlr_box box = { .x = lx, .y = ly };
+	scene_node_get_size(node, &box.width, &box.height);
+
+	if (!enabled || wlr_box_empty(&box)) {
+		if (node->index_leaf >= 0) {
+			box_tree_remove(scene->node_index, node->index_leaf);
+			node->index_leaf = -1;
+		}
+	} else if (node->index_leaf >= 0) {
+		box_tree_move(scene->node_index, node->index_leaf, &box);
+	} else {
+		node->index_leaf = box_tree_insert(scene->node_index, &box, node);
+		if (node->index_leaf < 0) {
+			wlr_log(WLR_ERROR, "Failed to add scene node to the index");
+		}
+	}
+}
+
 static void scene_node_opaque_region(struct wlr_scene_node *node, int x, int y,
 		pixman_region32_t *opaque) {
 	if (node->type == WLR_SCENE_NODE_RECT) {
@@ -241,7 +506,11 @@ static void scene_node_opaque_region(struct wlr_scene_node *node, int x, int y,
 			return;
 		}
 
-		if (!buffer_is_opaque(scene_buffer->buffer)) {
+		if (scene_buffer->single_pixel) {
+			if (scene_buffer->single_pixel_color[3] != 1) {
+				return;
+			}
+		} else if (!buffer_is_opaque(scene_buffer->buffer)) {
 			pixman_region32_copy(opaque, &scene_buffer->opaque_region);
 			pixman_region32_translate(opaque, x, y);
 			return;
@@ -494,6 +763,135 @@ static void scene_update_region(struct wlr_scene *scene,
 	scene_nodes_in_box(&scene->tree.node, &box, scene_node_update_iterator, &data);
 
 	pixman_region32_fini(&visible);
+
+	// node visibility only changed inside the update region, so outputs not
+	// intersecting it can keep their render list
+	struct wlr_scene_output *scene_output;
+	wl_list_for_each(scene_output, &scene->outputs, link) {
+		struct wlr_box output_box = { .x = scene_output->x, .y = scene_output->y };
+		wlr_output_effective_resolution(scene_output->output,
+			&output_box.width, &output_box.height);
+
+		struct wlr_box intersection;
+		if (wlr_box_intersection(&intersection, &output_box, &box)) {
+			scene_output->render_list_dirty = true;
+		}
+	}
+}
+
+void wlr_scene_flush(struct wlr_scene *scene) {
+	if (wl_list_empty(&scene->update_nodes)) {
+		return;
+	}
+
+	// Output enter/leave handlers may change the scene-graph again, these
+	// changes will be part of the next flush
+	struct wl_list nodes;
+	wl_list_init(&nodes);
+	wl_list_insert_list(&nodes, &scene->update_nodes);
+	wl_list_init(&scene->update_nodes);
+	scene->batch_frame_outputs = 0;
+
+	pixman_region32_t update_region, damage;
+	pixman_region32_init(&update_region);
+	pixman_region32_init(&damage);
+	pixman_region32_copy(&update_region, &scene->pending_update);
+	pixman_region32_copy(&damage, &scene->pending_damage);
+	pixman_region32_clear(&scene->pending_update);
+	pixman_region32_clear(&scene->pending_damage);
+
+	struct wlr_scene_node *node;
+	wl_list_for_each(node, &nodes, update_link) {
+		int x, y;
+		if (scene_node_get_root(node) == scene &&
+				wlr_scene_node_coords(node, &x, &y)) {
+			scene_node_bounds(node, x, y, &update_region);
+		}
+	}
+
+	if (pixman_region32_not_empty(&update_region)) {
+		scene_update_region(scene, &update_region);
+	}
+	pixman_region32_fini(&update_region);
+
+	// The pending damage holds what was visible before the changes, add what
+	// is visible after them
+	while (!wl_list_empty(&nodes)) {
+		node = wl_container_of(nodes.next, node, update_link);
+		wl_list_remove(&node->update_link);
+		wl_list_init(&node->update_link);
+
+		int x, y;
+		if (scene_node_get_root(node) == scene &&
+				wlr_scene_node_coords(node, &x, &y)) {
+			scene_node_visibility(node, &damage);
+		}
+	}
+
+	scene_damage_outputs(scene, &damage);
+	pixman_region32_fini(&damage);
+}
+
+/**
+ * Schedule a frame on the outputs intersecting the region, so that the
+ * pending update is flushed before they are next rendered.
+ */
+static void scene_schedule_batch_frames(struct wlr_scene *scene,
+		const pixman_region32_t *region) {
+	struct wlr_scene_output *scene_output;
+	wl_list_for_each(scene_output, &scene->outputs, link) {
+		uint64_t mask = 1ull << scene_output->index;
+		if (scene->batch_frame_outputs & mask) {
+			continue;
+		}
+
+		int width, height;
+		wlr_output_effective_resolution(scene_output->output, &width, &height);
+		pixman_box32_t output_box = {
+			.x1 = scene_output->x,
+			.y1 = scene_output->y,
+			.x2 = scene_output->x + width,
+			.y2 = scene_output->y + height,
+		};
+		if (pixman_region32_contains_rectangle(region, &output_box) ==
+				PIXMAN_REGION_OUT) {
+			continue;
+		}
+
+		scene->batch_frame_outputs |= mask;
+		wlr_output_schedule_frame(scene_output->output);
+	}
+}
+
+/**
+ * Queue a visibility update for the node, to be applied by wlr_scene_flush().
+ * damage holds the region the node was visible in before the change.
+ */
+static void scene_node_queue_update(struct wlr_scene_node *node,
+		pixman_region32_t *damage, bool enabled, int x, int y) {
+	struct wlr_scene *scene = scene_node_get_root(node);
+
+	pixman_region32_union(&scene->pending_update, &scene->pending_update, damage);
+	pixman_region32_union(&scene->pending_damage, &scene->pending_damage, damage);
+
+	// Computing the new bounds walks the node's children, only do it if some
+	// outputs don't have a frame scheduled for this batch yet
+	uint64_t all_outputs = 0;
+	struct wlr_scene_output *scene_output;
+	wl_list_for_each(scene_output, &scene->outputs, link) {
+		all_outputs |= 1ull << scene_output->index;
+	}
+	if ((scene->batch_frame_outputs & all_outputs) != all_outputs) {
+		if (enabled) {
+			scene_node_bounds(node, x, y, damage);
+		}
+		scene_schedule_batch_frames(scene, damage);
+	}
+	pixman_region32_fini(damage);
+
+	// The node may have been queued by another scene before being reparented
+	wl_list_remove(&node->update_link);
+	wl_list_insert(scene->update_nodes.prev, &node->update_link);
 }
 
 static void scene_node_update(struct wlr_scene_node *node,
@@ -501,23 +899,31 @@ static void scene_node_update(struct wlr_scene_node *node,
 	struct wlr_scene *scene = scene_node_get_root(node);
 
 	int x, y;
-	if (!wlr_scene_node_coords(node, &x, &y)) {
-		if (damage) {
-			scene_update_region(scene, damage);
-			scene_damage_outputs(scene, damage);
-			pixman_region32_fini(damage);
-		}
-
-		return;
-	}
+	bool enabled = wlr_scene_node_coords(node, &x, &y);
+	scene_node_update_index(scene, node, x, y, enabled);
 
 	pixman_region32_t visible;
 	if (!damage) {
+		if (!enabled) {
+			return;
+		}
 		pixman_region32_init(&visible);
 		scene_node_visibility(node, &visible);
 		damage = &visible;
 	}
 
+	if (scene->batching) {
+		scene_node_queue_update(node, damage, enabled, x, y);
+		return;
+	}
+
+	if (!enabled) {
+		scene_update_region(scene, damage);
+		scene_damage_outputs(scene, damage);
+		pixman_region32_fini(damage);
+		return;
+	}
+
 	pixman_region32_t update_region;
 	pixman_region32_init(&update_region);
 	pixman_region32_copy(&update_region, damage);
@@ -531,6 +937,18 @@ static void scene_node_update(struct wlr_scene_node *node,
 	pixman_region32_fini(damage);
 }
 
+void wlr_scene_set_batching(struct wlr_scene *scene, bool batching) {
+	if (scene->batching == batching) {
+		return;
+	}
+
+	// Apply the changes queued so far before going back to immediate updates
+	if (!batching) {
+		wlr_scene_flush(scene);
+	}
+	scene->batching = batching;
+}
+
 struct wlr_scene_rect *wlr_scene_rect_create(struct wlr_scene_tree *parent,
 		int width, int height, const float color[static 4]) {
 	struct wlr_scene_rect *scene_rect =
@@ -569,6 +987,48 @@ void wlr_scene_rect_set_color(struct wlr_scene_rect *rect, const float color[sta
 	scene_node_update(&rect->node, NULL);
 }
 
+/**
+ * Check whether the buffer is a single-pixel buffer and cache its color.
+ * Returns true if this changed how the node needs to be drawn.
+ */
+static bool scene_buffer_update_single_pixel(
+		struct wlr_scene_buffer *scene_buffer) {
+	struct wlr_buffer *buffer = scene_buffer->buffer;
+
+	// Surfaces display client buffers wrapping the buffer attached by the
+	// client
+	struct wlr_client_buffer *client_buffer = NULL;
+	if (buffer != NULL) {
+		client_buffer = wlr_client_buffer_get(buffer);
+	}
+	if (client_buffer != NULL && client_buffer->source != NULL) {
+		buffer = client_buffer->source;
+	}
+
+	struct wlr_single_pixel_buffer_v1 *single_pixel_buffer = NULL;
+	if (buffer != NULL) {
+		single_pixel_buffer = wlr_single_pixel_buffer_v1_try_from_buffer(buffer);
+	}
+
+	float color[4] = {0};
+	if (single_pixel_buffer != NULL) {
+		color[0] = (float)single_pixel_buffer->r / UINT32_MAX;
+		color[1] = (float)single_pixel_buffer->g / UINT32_MAX;
+		color[2] = (float)single_pixel_buffer->b / UINT32_MAX;
+		color[3] = (float)single_pixel_buffer->a / UINT32_MAX;
+	}
+
+	bool single_pixel = single_pixel_buffer != NULL;
+	if (single_pixel == scene_buffer->single_pixel &&
+			memcmp(color, scene_buffer->single_pixel_color, sizeof(color)) == 0) {
+		return false;
+	}
+
+	scene_buffer->single_pixel = single_pixel;
+	memcpy(scene_buffer->single_pixel_color, color, sizeof(color));
+	return true;
+}
+
 struct wlr_scene_buffer *wlr_scene_buffer_create(struct wlr_scene_tree *parent,
 		struct wlr_buffer *buffer) {
 	struct wlr_scene_buffer *scene_buffer = calloc(1, sizeof(*scene_buffer));
@@ -581,6 +1041,7 @@ struct wlr_scene_buffer *wlr_scene_buffer_create(struct wlr_scene_tree *parent,
 	if (buffer) {
 		scene_buffer->buffer = wlr_buffer_lock(buffer);
 	}
+	scene_buffer_update_single_pixel(scene_buffer);
 
 	wl_signal_init(&scene_buffer->events.outputs_update);
 	wl_signal_init(&scene_buffer->events.output_enter);
@@ -622,6 +1083,11 @@ void wlr_scene_buffer_set_buffer_with_damage(struct wlr_scene_buffer *scene_buff
 		scene_buffer->buffer = NULL;
 	}
 
+	// The opaque region of single-pixel buffers depends on their color
+	if (scene_buffer_update_single_pixel(scene_buffer)) {
+		update = true;
+	}
+
 	if (update) {
 		scene_node_update(&scene_buffer->node, NULL);
 		// updating the node will already damage the whole node for us. Return
@@ -772,6 +1238,11 @@ void wlr_scene_buffer_set_transform(struct wlr_scene_buffer *scene_buffer,
 	scene_node_update(&scene_buffer->node, NULL);
 }
 
+void wlr_scene_buffer_set_allow_tearing(struct wlr_scene_buffer *scene_buffer,
+		bool allow_tearing) {
+	scene_buffer->allow_tearing = allow_tearing;
+}
+
 void wlr_scene_buffer_send_frame_done(struct wlr_scene_buffer *scene_buffer,
 		struct timespec *now) {
 	if (pixman_region32_not_empty(&scene_buffer->node.visible)) {
@@ -877,6 +1348,7 @@ void wlr_scene_node_place_above(struct wlr_scene_node *node,
 
 	wl_list_remove(&node->link);
 	wl_list_insert(&sibling->link, &node->link);
+	scene_node_update_z_order(node);
 	scene_node_update(node, NULL);
 }
 
@@ -891,6 +1363,7 @@ void wlr_scene_node_place_below(struct wlr_scene_node *node,
 
 	wl_list_remove(&node->link);
 	wl_list_insert(sibling->link.prev, &node->link);
+	scene_node_update_z_order(node);
 	scene_node_update(node, NULL);
 }
 
@@ -933,9 +1406,16 @@ void wlr_scene_node_reparent(struct wlr_scene_node *node,
 		scene_node_visibility(node, &visible);
 	}
 
+	struct wlr_scene *old_scene = scene_node_get_root(node);
+	if (old_scene != scene_node_get_root(&new_parent->node)) {
+		// Drop the sub-tree from the index of the scene it's leaving
+		scene_node_update_index(old_scene, node, 0, 0, false);
+	}
+
 	wl_list_remove(&node->link);
 	node->parent = new_parent;
 	wl_list_insert(new_parent->children.prev, &node->link);
+	scene_node_update_z_order(node);
 	scene_node_update(node, &visible);
 }
 
@@ -1064,40 +1544,56 @@ static void scissor_output(struct wlr_output *output, pixman_box32_t *rect) {
 	wlr_renderer_scissor(renderer, &box);
 }
 
+static void render_op(struct wlr_output *output, pixman_region32_t *damage,
+		struct wlr_render_op *op) {
+	int ow, oh;
+	wlr_output_transformed_resolution(output, &ow, &oh);
+
+	// The damage is in output-buffer-local coordinates before the output
+	// transform is applied
+	pixman_region32_t clip;
+	pixman_region32_init(&clip);
+	wlr_region_transform(&clip, damage,
+		wlr_output_transform_invert(output->transform), ow, oh);
+
+	op->clip = &clip;
+	wlr_renderer_render_ops(output->renderer, op, 1);
+	pixman_region32_fini(&clip);
+}
+
 static void render_rect(struct wlr_output *output,
 		pixman_region32_t *damage, const float color[static 4],
 		const struct wlr_box *box, const float matrix[static 9]) {
-	struct wlr_renderer *renderer = output->renderer;
-	assert(renderer);
-
-	int nrects;
-	pixman_box32_t *rects = pixman_region32_rectangles(damage, &nrects);
-	for (int i = 0; i < nrects; ++i) {
-		scissor_output(output, &rects[i]);
-		wlr_render_rect(renderer, box, color, matrix);
+	if (wlr_box_empty(box)) {
+		return;
 	}
+
+	struct wlr_render_op op = {0};
+	memcpy(op.color, color, sizeof(op.color));
+	wlr_matrix_project_box(op.matrix, box, WL_OUTPUT_TRANSFORM_NORMAL, 0,
+		matrix);
+
+	render_op(output, damage, &op);
 }
 
 static void render_texture(struct wlr_output *output,
 		pixman_region32_t *damage, struct wlr_texture *texture,
 		const struct wlr_fbox *src_box, const struct wlr_box *dst_box,
 		const float matrix[static 9]) {
-	struct wlr_renderer *renderer = output->renderer;
-	assert(renderer);
-
-	struct wlr_fbox default_src_box = {0};
+	struct wlr_render_op op = {
+		.texture = texture,
+		.src_box = *src_box,
+		.alpha = 1.0,
+	};
 	if (wlr_fbox_empty(src_box)) {
-		default_src_box.width = texture->width;
-		default_src_box.height = texture->height;
-		src_box = &default_src_box;
+		op.src_box = (struct wlr_fbox){
+			.width = texture->width,
+			.height = texture->height,
+		};
 	}
+	memcpy(op.matrix, matrix, sizeof(op.matrix));
 
-	int nrects;
-	pixman_box32_t *rects = pixman_region32_rectangles(damage, &nrects);
-	for (int i = 0; i < nrects; ++i) {
-		scissor_output(output, &rects[i]);
-		wlr_render_subtexture_with_matrix(renderer, texture, src_box, matrix, 1.0);
-	}
+	render_op(output, damage, &op);
 }
 
 static void scene_node_render(struct wlr_scene_node *node,
@@ -1144,6 +1640,16 @@ static void scene_node_render(struct wlr_scene_node *node,
 		struct wlr_scene_buffer *scene_buffer = wlr_scene_buffer_from_node(node);
 		assert(scene_buffer->buffer);
 
+		if (scene_buffer->single_pixel) {
+			// No need to upload and sample a texture, the crop and transform
+			// of a single pixel don't matter either
+			render_rect(output, &render_region, scene_buffer->single_pixel_color,
+				&dst_box, output->transform_matrix);
+
+			wl_signal_emit_mutable(&scene_buffer->events.output_present, scene_output);
+			break;
+		}
+
 		struct wlr_renderer *renderer = output->renderer;
 		texture = scene_buffer_get_texture(scene_buffer, renderer);
 		if (texture == NULL) {
@@ -1198,6 +1704,114 @@ void wlr_scene_set_linux_dmabuf_v1(struct wlr_scene *scene,
 	wl_signal_add(&linux_dmabuf_v1->events.destroy, &scene->linux_dmabuf_v1_destroy);
 }
 
+/**
+ * An output layer displaying a buffer node on a scene output.
+ */
+struct scene_output_layer {
+	struct wlr_scene_output *scene_output;
+	struct wlr_scene_buffer *scene_buffer;
+	struct wlr_output_layer *layer;
+	struct wl_list link; // wlr_scene_output.layers
+
+	// Whether the layer displays its buffer in the current frame
+	bool used;
+	bool accepted;
+	// Position in output-buffer-local coordinates
+	int x, y;
+
+	struct wlr_addon addon; // wlr_scene_buffer.node.addons
+	struct wl_listener layer_feedback;
+};
+
+static void scene_output_layer_destroy(struct scene_output_layer *scene_layer) {
+	wlr_output_layer_destroy(scene_layer->layer);
+	wlr_addon_finish(&scene_layer->addon);
+	wl_list_remove(&scene_layer->layer_feedback.link);
+	wl_list_remove(&scene_layer->link);
+	free(scene_layer);
+}
+
+static void scene_output_layer_handle_addon_destroy(struct wlr_addon *addon) {
+	struct scene_output_layer *scene_layer =
+		wl_container_of(addon, scene_layer, addon);
+	scene_output_layer_destroy(scene_layer);
+}
+
+static const struct wlr_addon_interface scene_output_layer_addon_impl = {
+	.name = "scene_output_layer",
+	.destroy = scene_output_layer_handle_addon_destroy,
+};
+
+static void scene_buffer_send_dmabuf_feedback(const struct wlr_scene *scene,
+	struct wlr_scene_buffer *scene_buffer,
+	const struct wlr_linux_dmabuf_feedback_v1_init_options *options);
+
+static void scene_output_layer_handle_feedback(struct wl_listener *listener,
+		void *data) {
+	struct scene_output_layer *scene_layer =
+		wl_container_of(listener, scene_layer, layer_feedback);
+	const struct wlr_output_layer_feedback_event *event = data;
+	struct wlr_scene_output *scene_output = scene_layer->scene_output;
+
+	if (scene_layer->scene_buffer->primary_output != scene_output) {
+		return;
+	}
+
+	struct wlr_linux_dmabuf_feedback_v1_init_options options = {
+		.main_renderer = scene_output->output->renderer,
+		.output_layer_feedback_event = event,
+	};
+	scene_buffer_send_dmabuf_feedback(scene_output->scene,
+		scene_layer->scene_buffer, &options);
+}
+
+static struct scene_output_layer *scene_output_layer_get(
+		struct wlr_scene_output *scene_output,
+		struct wlr_scene_buffer *scene_buffer) {
+	struct wlr_addon *addon = wlr_addon_find(&scene_buffer->node.addons,
+		scene_output, &scene_output_layer_addon_impl);
+	if (addon == NULL) {
+		return NULL;
+	}
+	struct scene_output_layer *scene_layer =
+		wl_container_of(addon, scene_layer, addon);
+	return scene_layer;
+}
+
+static struct scene_output_layer *scene_output_layer_get_or_create(
+		struct wlr_scene_output *scene_output,
+		struct wlr_scene_buffer *scene_buffer) {
+	struct scene_output_layer *scene_layer =
+		scene_output_layer_get(scene_output, scene_buffer);
+	if (scene_layer != NULL) {
+		return scene_layer;
+	}
+
+	scene_layer = calloc(1, sizeof(*scene_layer));
+	if (scene_layer == NULL) {
+		return NULL;
+	}
+
+	scene_layer->layer = wlr_output_layer_create(scene_output->output);
+	if (scene_layer->layer == NULL) {
+		free(scene_layer);
+		return NULL;
+	}
+
+	scene_layer->scene_output = scene_output;
+	scene_layer->scene_buffer = scene_buffer;
+	wlr_addon_init(&scene_layer->addon, &scene_buffer->node.addons,
+		scene_output, &scene_output_layer_addon_impl);
+
+	scene_layer->layer_feedback.notify = scene_output_layer_handle_feedback;
+	wl_signal_add(&scene_layer->layer->events.feedback,
+		&scene_layer->layer_feedback);
+
+	wl_list_insert(scene_output->layers.prev, &scene_layer->link);
+
+	return scene_layer;
+}
+
 static void scene_output_handle_destroy(struct wlr_addon *addon) {
 	struct wlr_scene_output *scene_output =
 		wl_container_of(addon, scene_output, addon);
@@ -1228,6 +1842,7 @@ static void scene_output_update_geometry(struct wlr_scene_output *scene_output)
 	wlr_output_transformed_resolution(scene_output->output, &width, &height);
 	wlr_damage_ring_set_bounds(&scene_output->damage_ring, width, height);
 	wlr_output_schedule_frame(scene_output->output);
+	scene_output->render_list_dirty = true;
 
 	scene_node_output_update(&scene_output->scene->tree.node,
 			&scene_output->scene->outputs, NULL);
@@ -1261,6 +1876,216 @@ static void scene_output_handle_needs_frame(struct wl_listener *listener, void *
 	wlr_output_schedule_frame(scene_output->output);
 }
 
+#define SCENE_TIMING_LOG_FRAMES 600
+// 1ms wide buckets, the last one collects all slower frames
+#define SCENE_TIMING_BUCKETS 34
+
+struct scene_timing_buckets {
+	size_t frames;
+	uint32_t counts[SCENE_TIMING_BUCKETS];
+	int64_t max_ns;
+};
+
+struct scene_timing_histogram {
+	size_t frames, presented, failed;
+	struct wlr_scene_output_frame_timing total;
+	// Present latency and CPU time measure different things, so frames
+	// without a presentation timestamp are kept separate
+	struct scene_timing_buckets latency, cpu_time;
+};
+
+static double nsec_to_msec_double(int64_t nsec) {
+	return (double)nsec / 1000000;
+}
+
+static void timing_buckets_add(struct scene_timing_buckets *buckets,
+		int64_t duration_ns) {
+	int64_t bucket = duration_ns / 1000000;
+	if (bucket < 0) {
+		bucket = 0;
+	} else if (bucket >= SCENE_TIMING_BUCKETS) {
+		bucket = SCENE_TIMING_BUCKETS - 1;
+	}
+	buckets->counts[bucket]++;
+	if (duration_ns > buckets->max_ns) {
+		buckets->max_ns = duration_ns;
+	}
+	buckets->frames++;
+}
+
+/**
+ * Returns the upper bound of the bucket containing the given fraction of
+ * frames, in milliseconds.
+ */
+static int timing_buckets_percentile(const struct scene_timing_buckets *buckets,
+		double fraction) {
+	size_t target = fraction * buckets->frames;
+	size_t count = 0;
+	for (int i = 0; i < SCENE_TIMING_BUCKETS; i++) {
+		count += buckets->counts[i];
+		if (count >= target) {
+			return i + 1;
+		}
+	}
+	return SCENE_TIMING_BUCKETS;
+}
+
+static void timing_buckets_log(const struct scene_timing_buckets *buckets,
+		const char *output_name, const char *kind) {
+	if (buckets->frames == 0) {
+		return;
+	}
+
+	char str[512] = {0};
+	size_t len = 0;
+	for (int i = 0; i < SCENE_TIMING_BUCKETS && len < sizeof(str); i++) {
+		if (buckets->counts[i] == 0) {
+			continue;
+		}
+		if (i == SCENE_TIMING_BUCKETS - 1) {
+			len += snprintf(str + len, sizeof(str) - len,
+				" >%dms: %"PRIu32, i, buckets->counts[i]);
+		} else {
+			len += snprintf(str + len, sizeof(str) - len,
+				" %d-%dms: %"PRIu32, i, i + 1, buckets->counts[i]);
+		}
+	}
+
+	wlr_log(WLR_INFO, "Frame %s for output %s over %zu frames: "
+		"p50 <%dms, p90 <%dms, p99 <%dms, max %.2fms; histogram:%s",
+		kind, output_name, buckets->frames,
+		timing_buckets_percentile(buckets, 0.5),
+		timing_buckets_percentile(buckets, 0.9),
+		timing_buckets_percentile(buckets, 0.99),
+		nsec_to_msec_double(buckets->max_ns), str);
+}
+
+static void timing_histogram_log(struct scene_timing_histogram *histogram,
+		struct wlr_scene_output *scene_output) {
+	const char *name = scene_output->output->name;
+	const struct wlr_scene_output_frame_timing *total = &histogram->total;
+	double frames = histogram->frames;
+
+	wlr_log(WLR_INFO, "Frame timing for output %s over %zu frames "
+		"(%zu presented, %zu failed): render list %.2fms, cull %.2fms, "
+		"render %.2fms, cursors %.2fms, renderer end %.2fms, commit %.2fms "
+		"on average",
+		name, histogram->frames, histogram->presented, histogram->failed,
+		nsec_to_msec_double(total->render_list_ns) / frames,
+		nsec_to_msec_double(total->cull_ns) / frames,
+		nsec_to_msec_double(total->render_ns) / frames,
+		nsec_to_msec_double(total->cursors_ns) / frames,
+		nsec_to_msec_double(total->renderer_end_ns) / frames,
+		nsec_to_msec_double(total->commit_ns) / frames);
+
+	timing_buckets_log(&histogram->latency, name, "present latency");
+	timing_buckets_log(&histogram->cpu_time, name,
+		"CPU time (no presentation timestamp)");
+}
+
+static void timing_histogram_add(struct scene_timing_histogram *histogram,
+		struct wlr_scene_output *scene_output,
+		const struct wlr_scene_output_frame_timing *timing) {
+	struct wlr_scene_output_frame_timing *total = &histogram->total;
+	total->render_list_ns += timing->render_list_ns;
+	total->cull_ns += timing->cull_ns;
+	total->render_ns += timing->render_ns;
+	total->cursors_ns += timing->cursors_ns;
+	total->renderer_end_ns += timing->renderer_end_ns;
+	total->commit_ns += timing->commit_ns;
+
+	if (timing->present_ns != 0) {
+		timing_buckets_add(&histogram->latency, timing->present_ns);
+	} else {
+		timing_buckets_add(&histogram->cpu_time, timing->render_list_ns +
+			timing->cull_ns + timing->render_ns + timing->cursors_ns +
+			timing->renderer_end_ns + timing->commit_ns);
+	}
+
+	histogram->frames++;
+	if (timing->presented) {
+		histogram->presented++;
+	}
+	if (timing->failed) {
+		histogram->failed++;
+	}
+
+	if (histogram->frames >= SCENE_TIMING_LOG_FRAMES) {
+		timing_histogram_log(histogram, scene_output);
+		*histogram = (struct scene_timing_histogram){0};
+	}
+}
+
+static void scene_output_timing_finish(struct wlr_scene_output *scene_output) {
+	scene_output->timing_pending = false;
+
+	struct wlr_scene_output_frame_timing timing = scene_output->pending_timing;
+	if (scene_output->timing_histogram != NULL) {
+		timing_histogram_add(scene_output->timing_histogram, scene_output,
+			&timing);
+	}
+	wl_signal_emit_mutable(&scene_output->events.frame_timing, &timing);
+}
+
+static void scene_output_timing_begin_commit(
+		struct wlr_scene_output *scene_output,
+		const struct wlr_scene_output_frame_timing *timing, int64_t start_ns) {
+	scene_output->pending_timing = *timing;
+	scene_output->pending_timing.commit_seq =
+		scene_output->output->commit_seq + 1;
+	scene_output->pending_timing_start_ns = start_ns;
+	scene_output->timing_pending = true;
+	scene_output->timing_committing = true;
+	scene_output->timing_presented = false;
+}
+
+static void scene_output_timing_end_commit(struct wlr_scene_output *scene_output,
+		bool success, int64_t commit_ns) {
+	scene_output->timing_committing = false;
+	scene_output->pending_timing.commit_ns = commit_ns;
+
+	if (!success) {
+		if (scene_output->pending_timing.direct_scanout) {
+			// The frame is composited instead, and timed separately
+			scene_output->timing_pending = false;
+		} else {
+			scene_output->pending_timing.failed = true;
+			scene_output_timing_finish(scene_output);
+		}
+		return;
+	}
+
+	// Some backends send the present event while committing
+	if (scene_output->timing_presented) {
+		scene_output_timing_finish(scene_output);
+	}
+}
+
+static void scene_output_handle_present(struct wl_listener *listener, void *data) {
+	struct wlr_scene_output *scene_output = wl_container_of(listener,
+		scene_output, output_present);
+	struct wlr_output_event_present *event = data;
+
+	if (!scene_output->timing_pending ||
+			event->commit_seq != scene_output->pending_timing.commit_seq) {
+		return;
+	}
+
+	struct wlr_scene_output_frame_timing *timing = &scene_output->pending_timing;
+	timing->presented = event->presented;
+	if (event->presented && event->when != NULL &&
+			wlr_backend_get_presentation_clock(scene_output->output->backend) ==
+			CLOCK_MONOTONIC) {
+		timing->present_ns = timespec_to_nsec(event->when) -
+			scene_output->pending_timing_start_ns;
+	}
+	scene_output->timing_presented = true;
+
+	if (!scene_output->timing_committing) {
+		scene_output_timing_finish(scene_output);
+	}
+}
+
 struct wlr_scene_output *wlr_scene_output_create(struct wlr_scene *scene,
 		struct wlr_output *output) {
 	struct wlr_scene_output *scene_output = calloc(1, sizeof(*scene_output));
@@ -1274,6 +2099,7 @@ struct wlr_scene_output *wlr_scene_output_create(struct wlr_scene *scene,
 
 	wlr_damage_ring_init(&scene_output->damage_ring);
 	wl_list_init(&scene_output->damage_highlight_regions);
+	wl_list_init(&scene_output->layers);
 
 	int prev_output_index = -1;
 	struct wl_list *prev_output_link = &scene->outputs;
@@ -1293,6 +2119,15 @@ struct wlr_scene_output *wlr_scene_output_create(struct wlr_scene *scene,
 	wl_list_insert(prev_output_link, &scene_output->link);
 
 	wl_signal_init(&scene_output->events.destroy);
+	wl_signal_init(&scene_output->events.frame_timing);
+
+	if (scene->timing_log) {
+		scene_output->timing_histogram =
+			calloc(1, sizeof(*scene_output->timing_histogram));
+		if (scene_output->timing_histogram == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+		}
+	}
 
 	scene_output->output_commit.notify = scene_output_handle_commit;
 	wl_signal_add(&output->events.commit, &scene_output->output_commit);
@@ -1303,6 +2138,9 @@ struct wlr_scene_output *wlr_scene_output_create(struct wlr_scene *scene,
 	scene_output->output_needs_frame.notify = scene_output_handle_needs_frame;
 	wl_signal_add(&output->events.needs_frame, &scene_output->output_needs_frame);
 
+	scene_output->output_present.notify = scene_output_handle_present;
+	wl_signal_add(&output->events.present, &scene_output->output_present);
+
 	scene_output_update_geometry(scene_output);
 
 	return scene_output;
@@ -1329,14 +2167,22 @@ void wlr_scene_output_destroy(struct wlr_scene_output *scene_output) {
 		highlight_region_destroy(damage);
 	}
 
+	struct scene_output_layer *scene_layer, *tmp_scene_layer;
+	wl_list_for_each_safe(scene_layer, tmp_scene_layer, &scene_output->layers, link) {
+		scene_output_layer_destroy(scene_layer);
+	}
+
 	wlr_addon_finish(&scene_output->addon);
 	wlr_damage_ring_finish(&scene_output->damage_ring);
 	wl_list_remove(&scene_output->link);
 	wl_list_remove(&scene_output->output_commit.link);
 	wl_list_remove(&scene_output->output_damage.link);
 	wl_list_remove(&scene_output->output_needs_frame.link);
+	wl_list_remove(&scene_output->output_present.link);
+	free(scene_output->timing_histogram);
 
 	wl_array_release(&scene_output->render_list);
+	wl_array_release(&scene_output->layers_state);
 	free(scene_output);
 }
 
@@ -1397,11 +2243,19 @@ static bool construct_render_list_iterator(struct wlr_scene_node *node,
 	// while rendering, the background should always be black.
 	// If we see a black rect, we can ignore rendering everything under the rect
 	// and even the rect itself.
-	if (node->type == WLR_SCENE_NODE_RECT && data->calculate_visibility) {
-		struct wlr_scene_rect *rect = scene_rect_from_node(node);
-		float *black = (float[4]){ 0.f, 0.f, 0.f, 1.f };
+	if (data->calculate_visibility) {
+		const float *color = NULL;
+		if (node->type == WLR_SCENE_NODE_RECT) {
+			color = scene_rect_from_node(node)->color;
+		} else if (node->type == WLR_SCENE_NODE_BUFFER) {
+			struct wlr_scene_buffer *scene_buffer = wlr_scene_buffer_from_node(node);
+			if (scene_buffer->single_pixel) {
+				color = scene_buffer->single_pixel_color;
+			}
+		}
 
-		if (memcmp(rect->color, black, sizeof(float) * 4) == 0) {
+		float *black = (float[4]){ 0.f, 0.f, 0.f, 1.f };
+		if (color != NULL && memcmp(color, black, sizeof(float) * 4) == 0) {
 			return false;
 		}
 	}
@@ -1527,13 +2381,68 @@ static bool scene_buffer_can_consider_direct_scanout(struct wlr_scene_buffer *bu
 	return true;
 }
 
+static bool scene_output_build_layers_state(
+		struct wlr_scene_output *scene_output) {
+	struct wl_array *layers_state = &scene_output->layers_state;
+	layers_state->size = 0;
+
+	struct scene_output_layer *scene_layer;
+	wl_list_for_each(scene_layer, &scene_output->layers, link) {
+		struct wlr_output_layer_state *layer_state =
+			wl_array_add(layers_state, sizeof(*layer_state));
+		if (layer_state == NULL) {
+			return false;
+		}
+
+		*layer_state = (struct wlr_output_layer_state){
+			.layer = scene_layer->layer,
+		};
+		if (scene_layer->used) {
+			layer_state->buffer = scene_layer->scene_buffer->buffer;
+			layer_state->x = scene_layer->x;
+			layer_state->y = scene_layer->y;
+		}
+	}
+
+	return true;
+}
+
+static void scene_output_sweep_layers(struct wlr_scene_output *scene_output) {
+	// Layers which weren't used have just been disabled by the commit
+	struct scene_output_layer *scene_layer, *tmp_scene_layer;
+	wl_list_for_each_safe(scene_layer, tmp_scene_layer,
+			&scene_output->layers, link) {
+		if (!scene_layer->used) {
+			scene_output_layer_destroy(scene_layer);
+		}
+	}
+}
+
 static bool scene_buffer_try_direct_scanout(struct wlr_scene_buffer *buffer,
 		struct wlr_scene_output *scene_output) {
 	struct wlr_output_state state = {
 		.committed = WLR_OUTPUT_STATE_BUFFER,
 		.buffer = buffer->buffer,
+		.tearing_page_flip = buffer->allow_tearing,
 	};
 
+	if (!wl_list_empty(&scene_output->layers)) {
+		// The buffer covers the whole output, disable all output layers
+		struct scene_output_layer *scene_layer;
+		wl_list_for_each(scene_layer, &scene_output->layers, link) {
+			scene_layer->used = false;
+		}
+
+		if (!scene_output_build_layers_state(scene_output)) {
+			return false;
+		}
+
+		state.committed |= WLR_OUTPUT_STATE_LAYERS;
+		state.layers = scene_output->layers_state.data;
+		state.layers_len = scene_output->layers_state.size /
+			sizeof(struct wlr_output_layer_state);
+	}
+
 	if (!wlr_output_test_state(scene_output->output, &state)) {
 		return false;
 	}
@@ -1547,10 +2456,188 @@ static bool scene_buffer_try_direct_scanout(struct wlr_scene_buffer *buffer,
 	}
 
 	wlr_damage_ring_rotate(&scene_output->damage_ring);
+	scene_output_sweep_layers(scene_output);
 
 	return true;
 }
 
+static bool scene_buffer_can_use_output_layer(
+		struct wlr_scene_buffer *scene_buffer,
+		struct wlr_scene_output *scene_output, struct wlr_box *layer_box) {
+	struct wlr_output *output = scene_output->output;
+	struct wlr_buffer *buffer = scene_buffer->buffer;
+
+	// Output layers can't transform, crop nor scale buffers
+	if (output->transform != WL_OUTPUT_TRANSFORM_NORMAL ||
+			scene_buffer->transform != WL_OUTPUT_TRANSFORM_NORMAL) {
+		return false;
+	}
+
+	struct wlr_fbox buffer_box = {
+		.width = buffer->width,
+		.height = buffer->height,
+	};
+	if (!wlr_fbox_empty(&scene_buffer->src_box) &&
+			!wlr_fbox_equal(&scene_buffer->src_box, &buffer_box)) {
+		return false;
+	}
+
+	struct wlr_box box;
+	wlr_scene_node_coords(&scene_buffer->node, &box.x, &box.y);
+	scene_node_get_size(&scene_buffer->node, &box.width, &box.height);
+	box.x -= scene_output->x;
+	box.y -= scene_output->y;
+	scale_box(&box, output->scale);
+
+	if (box.width != buffer->width || box.height != buffer->height) {
+		return false;
+	}
+
+	struct wlr_box output_box = {
+		.width = output->width,
+		.height = output->height,
+	};
+	struct wlr_box intersection;
+	if (!wlr_box_intersection(&intersection, &output_box, &box) ||
+			!wlr_box_equal(&intersection, &box)) {
+		return false;
+	}
+
+	// Only buffers which can be imported by the backend have a chance
+	struct wlr_dmabuf_attributes dmabuf;
+	if (!wlr_buffer_get_dmabuf(buffer, &dmabuf)) {
+		return false;
+	}
+
+	*layer_box = box;
+	return true;
+}
+
+/**
+ * Try to display the topmost buffer nodes of the render list with output
+ * layers. Nodes are only eligible if nothing that needs to be composited is
+ * stacked above them. The backend tells us which layers it has accepted, the
+ * rest are composited as usual.
+ */
+static void scene_output_assign_layers(struct wlr_scene_output *scene_output,
+		struct wlr_scene_node **list_data, int list_len) {
+	struct wlr_output *output = scene_output->output;
+
+	struct scene_output_layer *scene_layer;
+	wl_list_for_each(scene_layer, &scene_output->layers, link) {
+		scene_layer->used = false;
+	}
+
+	// We don't want to hide highlight regions behind output layers
+	if (scene_output->scene->debug_damage_option ==
+			WLR_SCENE_DEBUG_DAMAGE_HIGHLIGHT) {
+		list_len = 0;
+	}
+
+	int output_width, output_height;
+	wlr_output_effective_resolution(output, &output_width, &output_height);
+
+	pixman_region32_t composited;
+	pixman_region32_init(&composited);
+
+	struct wl_list used;
+	wl_list_init(&used);
+	size_t used_len = 0;
+
+	for (int i = 0; i < list_len && used_len < SCENE_OUTPUT_MAX_LAYERS; i++) {
+		struct wlr_scene_node *node = list_data[i];
+
+		scene_layer = NULL;
+		struct wlr_box layer_box;
+		if (node->type == WLR_SCENE_NODE_BUFFER && scene_buffer_can_use_output_layer(
+				wlr_scene_buffer_from_node(node), scene_output, &layer_box)) {
+			// The visible region has the opaque nodes above already cut
+			// out, but those would be hidden by the layer: check the whole
+			// buffer instead
+			struct wlr_box node_box = {0};
+			wlr_scene_node_coords(node, &node_box.x, &node_box.y);
+			scene_node_get_size(node, &node_box.width, &node_box.height);
+
+			pixman_region32_t overlap;
+			pixman_region32_init_rect(&overlap, node_box.x, node_box.y,
+				node_box.width, node_box.height);
+			pixman_region32_intersect_rect(&overlap, &overlap,
+				scene_output->x, scene_output->y, output_width, output_height);
+			pixman_region32_intersect(&overlap, &overlap, &composited);
+			if (!pixman_region32_not_empty(&overlap)) {
+				scene_layer = scene_output_layer_get_or_create(scene_output,
+					wlr_scene_buffer_from_node(node));
+			}
+			pixman_region32_fini(&overlap);
+		}
+
+		if (scene_layer == NULL) {
+			pixman_region32_union(&composited, &composited, &node->visible);
+			continue;
+		}
+
+		scene_layer->used = true;
+		scene_layer->x = layer_box.x;
+		scene_layer->y = layer_box.y;
+
+		// Layers are ordered from bottom to top, but the render list is
+		// ordered from top to bottom
+		wl_list_remove(&scene_layer->link);
+		wl_list_insert(&used, &scene_layer->link);
+		used_len++;
+	}
+
+	pixman_region32_fini(&composited);
+	wl_list_insert_list(&scene_output->layers, &used);
+
+	if (wl_list_empty(&scene_output->layers) ||
+			!scene_output_build_layers_state(scene_output)) {
+		return;
+	}
+
+	struct wlr_output_layer_state *layers_state =
+		scene_output->layers_state.data;
+	size_t layers_len = scene_output->layers_state.size /
+		sizeof(struct wlr_output_layer_state);
+	wlr_output_set_layers(output, layers_state, layers_len);
+
+	if (!wlr_output_test(output)) {
+		// Composite everything and disable all layers
+		for (size_t i = 0; i < layers_len; i++) {
+			layers_state[i].buffer = NULL;
+			layers_state[i].accepted = false;
+		}
+	}
+
+	bool changed = false;
+	size_t i = 0;
+	wl_list_for_each(scene_layer, &scene_output->layers, link) {
+		bool accepted = scene_layer->used && layers_state[i].buffer != NULL &&
+			layers_state[i].accepted;
+		i++;
+
+		if (accepted != scene_layer->accepted) {
+			scene_layer->accepted = accepted;
+			changed = true;
+		}
+	}
+
+	if (changed) {
+		// Nodes which left an output layer need to be composited again
+		wlr_damage_ring_add_whole(&scene_output->damage_ring);
+	}
+}
+
+/**
+ * Returns the time elapsed since the stage started and starts the next one.
+ */
+static int64_t timing_stage_end(int64_t *stage_ns) {
+	int64_t now = get_current_time_nsec();
+	int64_t elapsed = now - *stage_ns;
+	*stage_ns = now;
+	return elapsed;
+}
+
 bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 	struct wlr_output *output = scene_output->output;
 	enum wlr_scene_debug_damage_option debug_damage =
@@ -1559,6 +2646,12 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 	struct wlr_renderer *renderer = output->renderer;
 	assert(renderer != NULL);
 
+	struct wlr_scene_output_frame_timing timing = { .output = scene_output };
+	int64_t start_ns = get_current_time_nsec();
+	int64_t stage_ns = start_ns;
+
+	wlr_scene_flush(scene_output->scene);
+
 	struct render_list_constructor_data list_con = {
 		.box = { .x = scene_output->x, .y = scene_output->y },
 		.render_list = &scene_output->render_list,
@@ -1567,14 +2660,21 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 	wlr_output_effective_resolution(output,
 		&list_con.box.width, &list_con.box.height);
 
-	list_con.render_list->size = 0;
-	scene_nodes_in_box(&scene_output->scene->tree.node, &list_con.box,
-		construct_render_list_iterator, &list_con);
-	array_realloc(list_con.render_list, list_con.render_list->size);
+	// The render list only needs to be rebuilt when node visibility changed
+	// on this output. Frames which only carry buffer damage reuse it.
+	if (scene_output->render_list_dirty) {
+		list_con.render_list->size = 0;
+		scene_nodes_in_box(&scene_output->scene->tree.node, &list_con.box,
+			construct_render_list_iterator, &list_con);
+		array_realloc(list_con.render_list, list_con.render_list->size);
+		scene_output->render_list_dirty = false;
+	}
 
 	int list_len = list_con.render_list->size / sizeof(struct wlr_scene_node *);
 	struct wlr_scene_node **list_data = list_con.render_list->data;
 
+	timing.render_list_ns = timing_stage_end(&stage_ns);
+
 	bool sent_direct_scanout_feedback = false;
 
 	// if there is only one thing to render let's see if that thing can be
@@ -1597,7 +2697,12 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 					sent_direct_scanout_feedback = true;
 				}
 
+				timing.direct_scanout = true;
+				scene_output_timing_begin_commit(scene_output, &timing, start_ns);
 				scanout = scene_buffer_try_direct_scanout(buffer, scene_output);
+				scene_output_timing_end_commit(scene_output, scanout,
+					timing_stage_end(&stage_ns));
+				timing.direct_scanout = false;
 			}
 		}
 	}
@@ -1664,8 +2769,14 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 		pixman_region32_fini(&acc_damage);
 	}
 
+	if (scene_output->scene->output_layers ||
+			!wl_list_empty(&scene_output->layers)) {
+		scene_output_assign_layers(scene_output, list_data, list_len);
+	}
+
 	int buffer_age;
 	if (!wlr_output_attach_render(output, &buffer_age)) {
+		wlr_output_rollback(output);
 		return false;
 	}
 
@@ -1686,6 +2797,8 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 		return false;
 	}
 
+	stage_ns = get_current_time_nsec();
+
 	pixman_region32_t background;
 	pixman_region32_init(&background);
 	pixman_region32_copy(&background, &damage);
@@ -1734,14 +2847,32 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 	}
 	pixman_region32_fini(&background);
 
+	timing.cull_ns = timing_stage_end(&stage_ns);
+
 	for (int i = list_len - 1; i >= 0; i--) {
 		struct wlr_scene_node *node = list_data[i];
+
+		struct scene_output_layer *scene_layer = NULL;
+		if (node->type == WLR_SCENE_NODE_BUFFER) {
+			scene_layer = scene_output_layer_get(scene_output,
+				wlr_scene_buffer_from_node(node));
+		}
+
+		if (scene_layer != NULL && scene_layer->accepted) {
+			// The backend takes care of displaying this buffer
+			wl_signal_emit_mutable(&scene_layer->scene_buffer->events.output_present,
+				scene_output);
+			continue;
+		}
+
 		scene_node_render(node, scene_output, &damage);
 
 		if (node->type == WLR_SCENE_NODE_BUFFER) {
 			struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(node);
 
-			if (buffer->primary_output == scene_output && !sent_direct_scanout_feedback) {
+			// Layers send their own feedback when the backend rejects them
+			if (buffer->primary_output == scene_output && !sent_direct_scanout_feedback &&
+					(scene_layer == NULL || !scene_layer->used)) {
 				struct wlr_linux_dmabuf_feedback_v1_init_options options = {
 					.main_renderer = output->renderer,
 					.scanout_primary_output = NULL,
@@ -1778,20 +2909,29 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 		}
 	}
 
+	timing.render_ns = timing_stage_end(&stage_ns);
+
 	wlr_output_render_software_cursors(output, &damage);
+	timing.cursors_ns = timing_stage_end(&stage_ns);
 
 	wlr_renderer_end(renderer);
 	pixman_region32_fini(&damage);
+	timing.renderer_end_ns = timing_stage_end(&stage_ns);
 
 	pixman_region32_t frame_damage;
 	get_frame_damage(scene_output, &frame_damage);
 	wlr_output_set_damage(output, &frame_damage);
 	pixman_region32_fini(&frame_damage);
 
+	scene_output_timing_begin_commit(scene_output, &timing, start_ns);
+	stage_ns = get_current_time_nsec();
 	bool success = wlr_output_commit(output);
+	scene_output_timing_end_commit(scene_output, success,
+		timing_stage_end(&stage_ns));
 
 	if (success) {
 		wlr_damage_ring_rotate(&scene_output->damage_ring);
+		scene_output_sweep_layers(scene_output);
 	}
 
 	if (debug_damage == WLR_SCENE_DEBUG_DAMAGE_HIGHLIGHT &&
@@ -1826,6 +2966,7 @@ static void scene_node_send_frame_done(struct wlr_scene_node *node,
 
 void wlr_scene_output_send_frame_done(struct wlr_scene_output *scene_output,
 		struct timespec *now) {
+	wlr_scene_flush(scene_output->scene);
 	scene_node_send_frame_done(&scene_output->scene->tree.node,
 		scene_output, now);
 }
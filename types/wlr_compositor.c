@@ -386,6 +386,13 @@ static void surface_apply_damage(struct wlr_surface *surface) {
 		wlr_buffer_unlock(&surface->buffer->base);
 	}
 	surface->buffer = buffer;
+
+	if (surface->early_buffer_release &&
+			wlr_texture_set_release_buffer(buffer->texture_set)) {
+		// The texture holds a copy, let the client re-use the buffer
+		wlr_buffer_unlock(surface->current.buffer);
+		surface->current.buffer = NULL;
+	}
 }
 
 static void surface_update_opaque_region(struct wlr_surface *surface) {
@@ -672,7 +679,9 @@ static void surface_handle_renderer_destroy(struct wl_listener *listener,
 }
 
 static struct wlr_surface *surface_create(struct wl_client *client,
-		uint32_t version, uint32_t id, struct wlr_renderer *renderer) {
+		uint32_t version, uint32_t id, struct wlr_compositor *compositor) {
+	struct wlr_renderer *renderer = compositor->renderer;
+
 	struct wlr_surface *surface = calloc(1, sizeof(struct wlr_surface));
 	if (!surface) {
 		wl_client_post_no_memory(client);
@@ -691,6 +700,7 @@ static struct wlr_surface *surface_create(struct wl_client *client,
 	wlr_log(WLR_DEBUG, "New wlr_surface %p (res %p)", surface, surface->resource);
 
 	surface->renderer = renderer;
+	surface->early_buffer_release = compositor->early_buffer_release;
 
 	surface_state_init(&surface->current);
 	surface_state_init(&surface->pending);
@@ -1108,7 +1118,7 @@ static void compositor_create_surface(struct wl_client *client,
 	struct wlr_compositor *compositor = compositor_from_resource(resource);
 
 	struct wlr_surface *surface = surface_create(client,
-		wl_resource_get_version(resource), id, compositor->renderer);
+		wl_resource_get_version(resource), id, compositor);
 	if (surface == NULL) {
 		wl_client_post_no_memory(client);
 		return;
@@ -6,6 +6,8 @@
 #include <wlr/util/box.h>
 
 #define WLR_DAMAGE_RING_MAX_RECTS 20
+#define WLR_DAMAGE_RING_TILE_SIZE 64
+#define WLR_DAMAGE_RING_MAX_TILE_SIZE 1024
 
 void wlr_damage_ring_init(struct wlr_damage_ring *ring) {
 	memset(ring, 0, sizeof(*ring));
@@ -84,6 +86,49 @@ void wlr_damage_ring_rotate(struct wlr_damage_ring *ring) {
 	pixman_region32_clear(&ring->current);
 }
 
+static int32_t snap_down(int32_t v, int32_t tile_size) {
+	int32_t r = v % tile_size;
+	return r < 0 ? v - r - tile_size : v - r;
+}
+
+static int32_t snap_up(int32_t v, int32_t tile_size, int32_t max) {
+	int64_t snapped = -(int64_t)snap_down(-v, tile_size);
+	return snapped > max ? max : snapped;
+}
+
+/**
+ * Grow each rectangle of the region to the grid of tiles it touches. Tiles
+ * which end up next to each other are merged by pixman, so scattered small
+ * damage is kept as a few tight rectangles instead of one large one.
+ */
+static bool region_snap_to_tiles(struct wlr_damage_ring *ring,
+		pixman_region32_t *region, int32_t tile_size) {
+	int n_rects;
+	pixman_box32_t *rects = pixman_region32_rectangles(region, &n_rects);
+
+	pixman_box32_t *snapped = malloc(n_rects * sizeof(*snapped));
+	if (snapped == NULL) {
+		return false;
+	}
+
+	for (int i = 0; i < n_rects; ++i) {
+		snapped[i] = (pixman_box32_t){
+			.x1 = snap_down(rects[i].x1, tile_size),
+			.y1 = snap_down(rects[i].y1, tile_size),
+			.x2 = snap_up(rects[i].x2, tile_size, ring->width),
+			.y2 = snap_up(rects[i].y2, tile_size, ring->height),
+		};
+	}
+
+	pixman_region32_t tiled;
+	pixman_region32_init_rects(&tiled, snapped, n_rects);
+	free(snapped);
+
+	pixman_region32_copy(region, &tiled);
+	pixman_region32_fini(&tiled);
+	return true;
+}
+
 void wlr_damage_ring_get_buffer_damage(struct wlr_damage_ring *ring,
 		int buffer_age, pixman_region32_t *damage) {
 	if (buffer_age <= 0 || buffer_age - 1 > WLR_DAMAGE_RING_PREVIOUS_LEN) {
@@ -99,7 +144,17 @@ void wlr_damage_ring_get_buffer_damage(struct wlr_damage_ring *ring,
 			pixman_region32_union(damage, damage, &ring->previous[j]);
 		}
 
-		// Check the number of rectangles
+		// Coarsen the damage on a grid of tiles until it has few enough
+		// rectangles, and only then fall back to its extents
+		for (int32_t tile_size = WLR_DAMAGE_RING_TILE_SIZE;
+				tile_size <= WLR_DAMAGE_RING_MAX_TILE_SIZE &&
+				pixman_region32_n_rects(damage) > WLR_DAMAGE_RING_MAX_RECTS;
+				tile_size *= 2) {
+			if (!region_snap_to_tiles(ring, damage, tile_size)) {
+				break;
+			}
+		}
+
 		int n_rects = pixman_region32_n_rects(damage);
 		if (n_rects > WLR_DAMAGE_RING_MAX_RECTS) {
 			pixman_box32_t *extents = pixman_region32_extents(damage);
@@ -54,7 +54,6 @@ struct wlr_shm_mapping {
 
 struct wlr_shm_sigbus_data {
 	struct wlr_shm_mapping *mapping;
-	struct sigaction prev_action;
 	struct wlr_shm_sigbus_data *_Atomic next;
 };
 
@@ -75,6 +74,12 @@ struct wlr_shm_buffer {
 // Needs to be a lock-free atomic because it's accessed from a signal handler
 static struct wlr_shm_sigbus_data *_Atomic sigbus_data = NULL;
 
+// The SIGBUS handler is installed on first access and stays installed for the
+// lifetime of the process, so that data pointer access doesn't need syscalls.
+// The signal handler resets it, hence the sig_atomic_t.
+static volatile sig_atomic_t sigbus_handler_installed = false;
+static struct sigaction sigbus_prev_action;
+
 static const struct wl_buffer_interface wl_buffer_impl;
 static const struct wl_shm_pool_interface pool_impl;
 static const struct wl_shm_interface shm_impl;
@@ -183,9 +188,6 @@ static bool buffer_get_shm(struct wlr_buffer *wlr_buffer,
 }
 
 static void handle_sigbus(int sig, siginfo_t *info, void *context) {
-	assert(sigbus_data != NULL);
-	struct sigaction prev_action = sigbus_data->prev_action;
-
 	// Check whether the offending address is inside of the wl_shm_pool's mapped
 	// space
 	uintptr_t addr = (uintptr_t)info->si_addr;
@@ -213,13 +215,39 @@ static void handle_sigbus(int sig, siginfo_t *info, void *context) {
 	return;
 
 reraise:
-	if (prev_action.sa_flags & SA_SIGINFO) {
-		prev_action.sa_sigaction(sig, info, context);
+	if (sigbus_prev_action.sa_flags & SA_SIGINFO) {
+		sigbus_prev_action.sa_sigaction(sig, info, context);
+	} else if (sigbus_prev_action.sa_handler != SIG_DFL &&
+			sigbus_prev_action.sa_handler != SIG_IGN) {
+		sigbus_prev_action.sa_handler(sig);
 	} else {
-		prev_action.sa_handler(sig);
+		// Restore the default action: the faulting instruction is executed
+		// again once we return and will trigger it
+		sigaction(SIGBUS, &sigbus_prev_action, NULL);
+		sigbus_handler_installed = false;
 	}
 }
 
+static bool install_sigbus_handler(void) {
+	if (sigbus_handler_installed) {
+		return true;
+	}
+
+	// SIGBUS is triggered if the client shrinks the backing file, and then we
+	// try to access the mapping
+	struct sigaction new_action = {
+		.sa_sigaction = handle_sigbus,
+		.sa_flags = SA_SIGINFO | SA_NODEFER,
+	};
+	if (sigaction(SIGBUS, &new_action, &sigbus_prev_action) != 0) {
+		wlr_log_errno(WLR_ERROR, "sigaction failed");
+		return false;
+	}
+
+	sigbus_handler_installed = true;
+	return true;
+}
+
 static bool buffer_begin_data_ptr_access(struct wlr_buffer *wlr_buffer,
 		uint32_t flags, void **data, uint32_t *format, size_t *stride) {
 	struct wlr_shm_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
@@ -229,27 +257,14 @@ static bool buffer_begin_data_ptr_access(struct wlr_buffer *wlr_buffer,
 		return false;
 	}
 
-	// Install a SIGBUS handler. SIGBUS is triggered if the client shrinks the
-	// backing file, and then we try to access the mapping.
-	struct sigaction prev_action;
-	if (sigbus_data == NULL) {
-		struct sigaction new_action = {
-			.sa_sigaction = handle_sigbus,
-			.sa_flags = SA_SIGINFO | SA_NODEFER,
-		};
-		if (sigaction(SIGBUS, &new_action, &prev_action) != 0) {
-			wlr_log_errno(WLR_ERROR, "sigaction failed");
-			return false;
-		}
-	} else {
-		prev_action = sigbus_data->prev_action;
+	if (!install_sigbus_handler()) {
+		return false;
 	}
 
 	struct wlr_shm_mapping *mapping = buffer->pool->mapping;
 
 	buffer->sigbus_data = (struct wlr_shm_sigbus_data){
 		.mapping = mapping,
-		.prev_action = prev_action,
 		.next = sigbus_data,
 	};
 	sigbus_data = &buffer->sigbus_data;
@@ -274,12 +289,6 @@ static void buffer_end_data_ptr_access(struct wlr_buffer *wlr_buffer) {
 		}
 	}
 
-	if (sigbus_data == NULL) {
-		if (sigaction(SIGBUS, &buffer->sigbus_data.prev_action, NULL) != 0) {
-			wlr_log_errno(WLR_ERROR, "sigaction failed");
-		}
-	}
-
 	mapping_consider_destroy(buffer->sigbus_data.mapping);
 }
 
@@ -0,0 +1,345 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "util/box_tree.h"
+
+struct box_tree_node {
+	struct wlr_box box;
+	void *data;
+	int parent; // next free node if unused
+	int left, right; // -1 for leaves
+	int height; // 0 for leaves, -1 for unused nodes
+};
+
+static struct box_tree_node *get_node(struct box_tree *tree, int i) {
+	assert(i >= 0 &&
+		(size_t)i < tree->nodes.size / sizeof(struct box_tree_node));
+	struct box_tree_node *nodes = tree->nodes.data;
+	return &nodes[i];
+}
+
+static bool node_is_leaf(const struct box_tree_node *node) {
+	return node->left < 0;
+}
+
+static void box_union(struct wlr_box *dst, const struct wlr_box *a,
+		const struct wlr_box *b) {
+	int x1 = a->x < b->x ? a->x : b->x;
+	int y1 = a->y < b->y ? a->y : b->y;
+	int x2 = a->x + a->width > b->x + b->width ?
+		a->x + a->width : b->x + b->width;
+	int y2 = a->y + a->height > b->y + b->height ?
+		a->y + a->height : b->y + b->height;
+
+	dst->x = x1;
+	dst->y = y1;
+	dst->width = x2 - x1;
+	dst->height = y2 - y1;
+}
+
+static int64_t box_perimeter(const struct wlr_box *box) {
+	return 2 * ((int64_t)box->width + box->height);
+}
+
+static bool boxes_overlap(const struct wlr_box *a, const struct wlr_box *b) {
+	return a->x < b->x + b->width && b->x < a->x + a->width &&
+		a->y < b->y + b->height && b->y < a->y + a->height;
+}
+
+void box_tree_init(struct box_tree *tree) {
+	wl_array_init(&tree->nodes);
+	tree->root = -1;
+	tree->free_list = -1;
+}
+
+void box_tree_finish(struct box_tree *tree) {
+	wl_array_release(&tree->nodes);
+}
+
+static int alloc_node(struct box_tree *tree) {
+	if (tree->free_list < 0) {
+		struct box_tree_node *node = wl_array_add(&tree->nodes, sizeof(*node));
+		if (node == NULL) {
+			return -1;
+		}
+		node->parent = -1;
+		node->height = -1;
+		tree->free_list = tree->nodes.size / sizeof(*node) - 1;
+	}
+
+	int i = tree->free_list;
+	struct box_tree_node *node = get_node(tree, i);
+	tree->free_list = node->parent;
+	*node = (struct box_tree_node){
+		.parent = -1,
+		.left = -1,
+		.right = -1,
+	};
+	return i;
+}
+
+static void free_node(struct box_tree *tree, int i) {
+	struct box_tree_node *node = get_node(tree, i);
+	node->data = NULL;
+	node->parent = tree->free_list;
+	node->height = -1;
+	tree->free_list = i;
+}
+
+static void refit(struct box_tree *tree, int i) {
+	struct box_tree_node *node = get_node(tree, i);
+	struct box_tree_node *left = get_node(tree, node->left);
+	struct box_tree_node *right = get_node(tree, node->right);
+
+	node->height = 1 + (left->height > right->height ?
+		left->height : right->height);
+	box_union(&node->box, &left->box, &right->box);
+}
+
+static void replace_child(struct box_tree *tree, int parent, int old, int new) {
+	if (parent < 0) {
+		tree->root = new;
+		return;
+	}
+
+	struct box_tree_node *node = get_node(tree, parent);
+	if (node->left == old) {
+		node->left = new;
+	} else {
+		assert(node->right == old);
+		node->right = new;
+	}
+}
+
+/**
+ * Rotate the child subtree of node a which is taller by more than one level
+ * up. Returns the new root of the subtree.
+ */
+static int balance(struct box_tree *tree, int ia) {
+	struct box_tree_node *a = get_node(tree, ia);
+	if (node_is_leaf(a) || a->height < 2) {
+		return ia;
+	}
+
+	int ib = a->left, ic = a->right;
+	struct box_tree_node *b = get_node(tree, ib);
+	struct box_tree_node *c = get_node(tree, ic);
+
+	int diff = c->height - b->height;
+	if (diff > 1) {
+		int i_f = c->left, i_g = c->right;
+		struct box_tree_node *f = get_node(tree, i_f);
+		struct box_tree_node *g = get_node(tree, i_g);
+
+		c->left = ia;
+		c->parent = a->parent;
+		a->parent = ic;
+		replace_child(tree, c->parent, ia, ic);
+
+		if (f->height > g->height) {
+			c->right = i_f;
+			a->right = i_g;
+			g->parent = ia;
+		} else {
+			c->right = i_g;
+			a->right = i_f;
+			f->parent = ia;
+		}
+
+		refit(tree, ia);
+		refit(tree, ic);
+		return ic;
+	} else if (diff < -1) {
+		int i_d = b->left, i_e = b->right;
+		struct box_tree_node *d = get_node(tree, i_d);
+		struct box_tree_node *e = get_node(tree, i_e);
+
+		b->left = ia;
+		b->parent = a->parent;
+		a->parent = ib;
+		replace_child(tree, b->parent, ia, ib);
+
+		if (d->height > e->height) {
+			b->right = i_d;
+			a->left = i_e;
+			e->parent = ia;
+		} else {
+			b->right = i_e;
+			a->left = i_d;
+			d->parent = ia;
+		}
+
+		refit(tree, ia);
+		refit(tree, ib);
+		return ib;
+	}
+
+	return ia;
+}
+
+static void walk_up(struct box_tree *tree, int i) {
+	while (i >= 0) {
+		i = balance(tree, i);
+		refit(tree, i);
+		i = get_node(tree, i)->parent;
+	}
+}
+
+static int64_t descend_cost(struct box_tree *tree, int i,
+		const struct wlr_box *box) {
+	struct box_tree_node *node = get_node(tree, i);
+	struct wlr_box combined;
+	box_union(&combined, &node->box, box);
+
+	int64_t cost = box_perimeter(&combined);
+	if (!node_is_leaf(node)) {
+		cost -= box_perimeter(&node->box);
+	}
+	return cost;
+}
+
+static bool insert_leaf(struct box_tree *tree, int leaf) {
+	if (tree->root < 0) {
+		tree->root = leaf;
+		get_node(tree, leaf)->parent = -1;
+		return true;
+	}
+
+	// This may grow the node array, so it needs to happen before we take any
+	// pointers into it
+	int parent = alloc_node(tree);
+	if (parent < 0) {
+		return false;
+	}
+
+	struct wlr_box box = get_node(tree, leaf)->box;
+
+	// Find the sibling which grows the total perimeter of the tree the least
+	int sibling = tree->root;
+	while (!node_is_leaf(get_node(tree, sibling))) {
+		struct box_tree_node *node = get_node(tree, sibling);
+
+		struct wlr_box combined;
+		box_union(&combined, &node->box, &box);
+		int64_t cost = 2 * box_perimeter(&combined);
+		int64_t inheritance =
+			2 * (box_perimeter(&combined) - box_perimeter(&node->box));
+
+		int64_t cost_left = descend_cost(tree, node->left, &box) + inheritance;
+		int64_t cost_right = descend_cost(tree, node->right, &box) + inheritance;
+
+		if (cost < cost_left && cost < cost_right) {
+			break;
+		}
+
+		sibling = cost_left < cost_right ? node->left : node->right;
+	}
+
+	struct box_tree_node *sibling_node = get_node(tree, sibling);
+	struct box_tree_node *parent_node = get_node(tree, parent);
+	struct box_tree_node *leaf_node = get_node(tree, leaf);
+
+	int old_parent = sibling_node->parent;
+	parent_node->parent = old_parent;
+	parent_node->left = sibling;
+	parent_node->right = leaf;
+	parent_node->height = sibling_node->height + 1;
+	box_union(&parent_node->box, &sibling_node->box, &leaf_node->box);
+	sibling_node->parent = parent;
+	leaf_node->parent = parent;
+	replace_child(tree, old_parent, sibling, parent);
+
+	walk_up(tree, parent);
+	return true;
+}
+
+static void remove_leaf(struct box_tree *tree, int leaf) {
+	if (tree->root == leaf) {
+		tree->root = -1;
+		return;
+	}
+
+	int parent = get_node(tree, leaf)->parent;
+	struct box_tree_node *parent_node = get_node(tree, parent);
+	int grand_parent = parent_node->parent;
+	int sibling = parent_node->left == leaf ?
+		parent_node->right : parent_node->left;
+
+	replace_child(tree, grand_parent, parent, sibling);
+	get_node(tree, sibling)->parent = grand_parent;
+	free_node(tree, parent);
+
+	walk_up(tree, grand_parent);
+}
+
+int box_tree_insert(struct box_tree *tree, const struct wlr_box *box,
+		void *data) {
+	assert(!wlr_box_empty(box));
+
+	int leaf = alloc_node(tree);
+	if (leaf < 0) {
+		return -1;
+	}
+
+	struct box_tree_node *node = get_node(tree, leaf);
+	node->box = *box;
+	node->data = data;
+
+	if (!insert_leaf(tree, leaf)) {
+		free_node(tree, leaf);
+		return -1;
+	}
+
+	return leaf;
+}
+
+void box_tree_remove(struct box_tree *tree, int leaf) {
+	assert(node_is_leaf(get_node(tree, leaf)));
+
+	remove_leaf(tree, leaf);
+	free_node(tree, leaf);
+}
+
+void box_tree_move(struct box_tree *tree, int leaf, const struct wlr_box *box) {
+	assert(!wlr_box_empty(box));
+
+	struct box_tree_node *node = get_node(tree, leaf);
+	assert(node_is_leaf(node));
+	if (wlr_box_equal(&node->box, box)) {
+		return;
+	}
+
+	remove_leaf(tree, leaf);
+	get_node(tree, leaf)->box = *box;
+
+	// Removing the leaf has put its old parent on the free list, so this
+	// can't fail
+	bool ok = insert_leaf(tree, leaf);
+	assert(ok);
+	(void)ok;
+}
+
+static bool query_node(struct box_tree *tree, int i, const struct wlr_box *box,
+		box_tree_iterator_func_t iterator, void *user_data) {
+	struct box_tree_node *node = get_node(tree, i);
+	if (!boxes_overlap(&node->box, box)) {
+		return false;
+	}
+
+	if (node_is_leaf(node)) {
+		return iterator(node->data, &node->box, user_data);
+	}
+
+	int right = node->right;
+	return query_node(tree, node->left, box, iterator, user_data) ||
+		query_node(tree, right, box, iterator, user_data);
+}
+
+bool box_tree_query(struct box_tree *tree, const struct wlr_box *box,
+		box_tree_iterator_func_t iterator, void *user_data) {
+	if (tree->root < 0 || wlr_box_empty(box)) {
+		return false;
+	}
+
+	return query_node(tree, tree->root, box, iterator, user_data);
+}